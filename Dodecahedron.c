@@ -3,12 +3,38 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <string.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sched.h>
+#include <signal.h>
+#include <sys/inotify.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
 
 #define WINDOW_WIDTH 800
 #define WINDOW_HEIGHT 600
 #define NUM_VERTICES 20
 #define TOL 1e-6
 #define MAX_PLANES 30
+#define TILE_SIZE 32
+#define BG_COLOR 0x00FF00 // bg R, G, B Currently: Green
+
+// Face IDs are per pixel; anything below FACE_INSIDE is a plane index
+#define FACE_MISS 0xFF
+#define FACE_INSIDE 0xFE // hit but no entry plane (camera inside the solid)
+#define FACE_UNTRACED 0xFD
+
+#define MAX_FACE_VERTICES 64
 
 typedef struct {
     double x, y, z;
@@ -19,6 +45,297 @@ typedef struct {
     double d;
 } Plane;
 
+typedef struct {
+    int width, height;
+    uint32_t *pixels;
+    uint8_t *faceIds;
+    int idsValid;    // faceIds hold a finished frame rendered at idsAngle
+    double idsAngle;
+} Frame;
+
+// Foveated rendering: full resolution inside innerRadius, 1/2 up to
+// outerRadius and 1/4 beyond, all measured from the screen center in pixels
+typedef struct {
+    int innerRadius; // 0 = off
+    int outerRadius;
+} Foveation;
+
+// AOVs written alongside the color buffer for compositing. Layout on disk
+// and in shared memory: AovHeader, depth, normal, face IDs, position.
+#define AOV_MAGIC 0x564F4144 // "DAOV"
+#define AOV_DEPTH_MISS 0xFFFF
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t width, height;
+    uint32_t frame;
+    volatile uint32_t seq; // odd while the frame is being written (shared memory)
+    float depthNear, depthFar; // depth maps linearly onto 0..0xFFFE
+} AovHeader;
+
+typedef struct {
+    AovHeader *header;
+    uint16_t *depth;    // linear t between depthNear and depthFar
+    uint16_t *normal;   // octahedral, two snorm8 (x low byte)
+    uint8_t *faceIds;
+    uint16_t *position; // hit point as three IEEE halfs
+    size_t size;
+    int shmFd;
+    FILE *dump;
+    const char *dumpPrefix;
+} AovBuffers;
+
+// Progressive path tracing: samples accumulate while the angle stays put
+typedef struct {
+    float *accum;    // linear RGB sums per pixel
+    int samples;     // per pixel so far
+    double angle;    // angle the accumulation belongs to
+    int sppPerFrame;
+    int maxBounces;
+    Vec3 lightDir;
+} PathTracer;
+
+// Progressive refinement: a 1/8 resolution frame right away, then each
+// tile refines to 1/4, 1/2, full resolution and jittered supersamples on
+// later frames while the angle stays put. Every level only traces the grid
+// points the coarser ones did not.
+#define PROGRESSIVE_START 8
+
+typedef struct {
+    uint8_t *tileStep;      // finest grid step finished per tile, 0 = none
+    uint16_t *tileSamples;  // supersamples accumulated per tile once at step 1
+    float *accum;           // RGB sums for the supersampling stage
+    int numTiles;
+    int maxSamples;
+    double angle;
+    Uint64 deadline;        // tiles starting past this wait for the next frame
+    Uint64 budget;          // refinement time per frame in counter ticks
+    SDL_atomic_t pending;   // tiles with work left after this frame
+} Progressive;
+
+// Image-based lighting from an equirectangular environment. Diffuse comes
+// from its 9-coefficient SH projection, evaluated once per face per frame;
+// the optional specular term samples a box-filtered mip chain per pixel.
+#define ENV_MAX_MIPS 12
+
+typedef struct {
+    float sh[9][3];
+    float *mip[ENV_MAX_MIPS]; // linear RGB, level 0 is the source
+    int mipW[ENV_MAX_MIPS], mipH[ENV_MAX_MIPS];
+    int numMips;
+    float roughness; // specular lobe width 0..1, < 0 = diffuse only
+    float exposure;
+} EnvLighting;
+
+// Prebuilt background layer, copied into miss spans instead of being
+// written pixel by pixel. Rebuilt only when marked dirty or resized.
+enum { BG_SOLID, BG_GRADIENT, BG_IMAGE };
+
+typedef struct {
+    int kind;
+    uint32_t color;        // BG_SOLID
+    uint32_t top, bottom;  // BG_GRADIENT
+    const char *path;      // BG_IMAGE, any BMP SDL can load, scaled to fit
+    int width, height;
+    uint32_t *pixels;
+    int dirty;
+} Background;
+
+// Translucent modes: blended front/back faces, or Beer-Lambert absorption
+// of the background over the chord through the solid
+enum { TRANSLUCENT_XRAY = 1, TRANSLUCENT_ABSORB };
+
+typedef struct {
+    int mode;
+    float alpha;    // X-ray opacity of each face
+    float sigma[3]; // absorption per unit length, R G B
+} Translucency;
+
+// Impostor LOD (--lod): an instance projecting smaller than lodSprite pixels
+// is drawn from a face-ID sprite of its plane set seen along the nearest of
+// LOD_DIRS x LOD_DIRS octahedral view directions, and one smaller than
+// lodDisc pixels as a disc in the average of its visible face colors.
+#define LOD_TEXELS 32 // sprite texels across the bounding sphere
+#define LOD_DIRS 16
+
+enum { LOD_FULL, LOD_SPRITE, LOD_DISC };
+
+typedef struct {
+    uint8_t face[LOD_TEXELS * LOD_TEXELS]; // FACE_MISS off the solid
+    int8_t depth[LOD_TEXELS * LOD_TEXELS]; // entry point relative to the center, radius / 127 units
+    uint16_t area[MAX_PLANES];             // texels per face
+    uint8_t mainFace;
+    float discRadius; // of a disc covering as much, for a bounding radius of 1
+} LodSprite;
+
+// Multi-instance scenes (--scene). Every frame each instance gets world
+// space planes and shaded face colors, and the visible ones are binned into
+// the tiles their bounding spheres cover, nearest first.
+typedef struct {
+    Vec3 center;
+    double radius;
+    double inner;           // inscribed sphere, 0 if it can't occlude
+    double depth;           // nearest depth along the view axis
+    int firstPlane;         // into SceneView.planes
+    int numPlanes;
+    int instance;           // index in the scene file, -1 for a chunk impostor
+    int x0, y0, x1, y1;     // pixel bounds
+    int tx0, ty0, tx1, ty1; // tiles covered, empty when off screen
+    int lod;                // LOD_*; chunk impostors are discs
+    const LodSprite *sprite;
+    Vec3 spriteX, spriteY;  // world offset from the center to texels
+    uint32_t color;         // discs only
+    uint8_t face;
+} SceneItem;
+
+typedef struct {
+    Plane *planes;     // world space, all instances back to back
+    uint32_t *colors;  // shaded color per world plane
+    SceneItem *items;  // after binning: the visible instances, nearest first
+    int numItems;
+    int itemCapacity, planeCapacity;
+    int *pending;      // instances to build this frame
+    int pendingCapacity;
+    int *impostors;    // chunks in view that are not paged in yet
+    int numImpostors, impostorCapacity;
+    int *binStart;     // numTiles + 1 offsets into binItems
+    int *binFill;
+    int tileCapacity;
+    int *binItems;
+    int binCapacity;
+    int binned;        // sum of the bin lengths
+    SDL_atomic_t tests; // ray-instance slab tests, for the stats line
+    double lodSprite, lodDisc; // projected diameters in pixels, 0 = always trace
+    int lodCount[3];           // instances drawn per LOD_* since the last stats line
+    int occlusion;             // --hiz
+    float *hiz;                // max depth pyramid, finest level first
+    int hizCapacity;
+    int hizTested, hizCulled, hizOccluders; // since the last stats line
+    Uint64 hizTicks;
+} SceneView;
+
+typedef struct {
+    const Plane *planes;
+    int numPlanes;
+    Vec3 camPos;
+    Vec3 camRight, camUp, camForward; // orthonormal, forward into the screen
+    double angle; // rotation the planes were built for
+    double scaleFactor;
+    double halfWidth, halfHeight;
+    uint32_t faceColor[256]; // flat shading, so color is a function of face ID
+    Foveation fovea;
+    Frame *frame;
+    AovBuffers *aov; // NULL when AOV export is off
+    PathTracer *pt;  // NULL unless path tracing
+    Progressive *progressive; // NULL unless progressive refinement is on
+    const EnvLighting *env;   // NULL = the directional light
+    const uint32_t *background; // frame-sized background layer
+    const Translucency *translucency; // NULL = opaque
+    int scalarKernel; // per-pixel traceRay() even at full resolution
+    SceneView *scene; // NULL = the single solid
+} RenderContext;
+
+// Post-processing between shading and SDL_UpdateTexture
+typedef struct {
+    int bloom;
+    int outline;
+    float bloomThreshold;
+    float bloomStrength;
+    float *lut; // lutSize^3 RGB entries, red fastest (.cube order)
+    int lutSize;
+} PostOptions;
+
+typedef struct {
+    Foveation fovea;
+    int threads;
+    int benchRays; // run the ray query benchmark with this many rays and exit
+    int benchPoints;
+    int benchCoverage; // frames for the analytic AA vs supersampling comparison
+    int voxelRes;           // bake a voxelRes^3 volume into voxelPath and exit
+    const char *voxelPath;
+    int voxelSdf;
+    const char *meshPath; // export the plane set as a mesh and exit
+    int pathTrace;        // samples per pixel per frame, 0 = off
+    int progressive;      // refinement budget per frame in ms, 0 = off
+    int ibl;
+    const char *envPath;  // equirectangular BMP, NULL = procedural sky
+    float roughness;
+    Background background;
+    Translucency translucency;
+    int analyticAA;
+    PostOptions post;
+    const char *aovDump; // file prefix, one file per frame
+    const char *aovShm;  // POSIX shared memory name
+    const char *recordPath; // face ID recording written while running
+    const char *playPath;   // recording to play back instead of rendering
+    const char *benchPlay;
+    const char *controlPath; // Unix socket for live commands
+    int metricsPort;         // Prometheus endpoint on 127.0.0.1, 0 = off
+    int streamPort;          // serve the frames over TCP, 0 = off
+    const char *viewAddr;    // HOST:PORT to watch instead of rendering
+    const char *views;       // viewport layout, NULL = the single camera
+    int wallCols, wallRows, wallIndex; // video wall cell, wallCols = 0 when off
+    const char *wallShm;
+    const char *scenePath;      // binary scene to render, hot reloaded
+    const char *writeScenePath; // write a demo scene of writeSceneCount instances and exit
+    int writeSceneCount;
+    int writeSceneField;        // the chunked fly-through layout
+    int testScene;              // check the scene validation against broken scenes and exit
+    int sceneBudget;            // page cache allowance for chunked scenes, MB
+    double flySpeed;            // camera speed along +z, 0 = fixed camera
+    double lodSprite, lodDisc;  // impostor LOD thresholds, projected diameter in pixels
+    int occlusion;              // hierarchical-Z culling of scene instances
+    int shatter;                // Voronoi shards to break the solid into, 0 = off
+    int benchLod;               // frames for the LOD vs full trace comparison
+} Options;
+
+/*
+ * Batch ray queries, structure-of-arrays in and out. Rays with FACE_MISS in
+ * face still get their raw tNear/tFar. Build with -DDODECAHEDRON_NO_MAIN to
+ * link traceRays()/traceRaysParallel() into another program.
+ */
+typedef struct {
+    const double *ox, *oy, *oz;
+    const double *dx, *dy, *dz;
+    double *tNear, *tFar;
+    uint8_t *face;
+    int count;
+    uint8_t *exitFace; // optional, the plane that set tFar
+} RayBatch;
+
+// Batch point containment, SoA in and out. dist is max(dot(n, p) - d) over
+// the planes: the exact distance to the surface for inside points and a lower
+// bound on it for outside ones. |dist| <= TOL counts as on the surface.
+enum { POINT_INSIDE = 0, POINT_ON_SURFACE = 1, POINT_OUTSIDE = 2 };
+
+typedef struct {
+    const double *px, *py, *pz;
+    uint8_t *cls;  // POINT_*
+    double *dist;  // may be NULL
+    int count;
+} PointBatch;
+
+typedef void (*JobFn)(void *arg, int index);
+
+// Tile worker pool: the calling thread runs jobs too, so threads - 1 workers
+typedef struct {
+    SDL_Thread *threads[64];
+    int numWorkers;
+    SDL_mutex *lock;
+    SDL_cond *start;
+    SDL_cond *done;
+    JobFn fn;
+    void *arg;
+    int count;
+    SDL_atomic_t next;
+    int running;
+    unsigned generation;
+    int quit;
+    SDL_atomic_t slots;
+    Uint64 busy[65]; // performance counter ticks spent in jobs, slot 0 = calling thread
+} WorkerPool;
+
 const double phi = (1.0 + sqrt(5.0)) / 2.0;
 const double invphi = 1.0 / phi;
 Vec3 baseVertices[NUM_VERTICES] = {
@@ -77,6 +394,17 @@ static Vec3 rotate(Vec3 v, double angle) {
     return (Vec3){ x, y2, z2 };
 }
 
+// Inverse of rotate()
+static Vec3 unrotate(Vec3 v, double angle) {
+    double cosB = cos(angle * 0.5), sinB = sin(angle * 0.5);
+    double y = cosB * v.y + sinB * v.z;
+    double z = -sinB * v.y + cosB * v.z;
+    double cosA = cos(angle), sinA = sin(angle);
+    double x = cosA * v.x - sinA * z;
+    double z2 = sinA * v.x + cosA * z;
+    return (Vec3){ x, y, z2 };
+}
+
 
 int computeBasePlanes(const Vec3 *vertices, int numVertices, Plane *planes, int maxPlanes) {
     int count = 0;
@@ -121,153 +449,6384 @@ int computeBasePlanes(const Vec3 *vertices, int numVertices, Plane *planes, int
     return count;
 }
 
-int main(int argc, char* argv[]) {
-    // Seed random generator (no longer used I like bloat)
-    srand((unsigned int)SDL_GetTicks());
+static void runJobs(WorkerPool *pool, int slot) {
+    Uint64 start = SDL_GetPerformanceCounter();
+    int i;
+    while ((i = SDL_AtomicAdd(&pool->next, 1)) < pool->count)
+        pool->fn(pool->arg, i);
+    pool->busy[slot] += SDL_GetPerformanceCounter() - start;
+}
 
-    if (SDL_Init(SDL_INIT_VIDEO) < 0) {
-        fprintf(stderr, "SDL_Init Error: %s\n", SDL_GetError());
-        return 1;
+static int workerMain(void *data) {
+    WorkerPool *pool = data;
+    int slot = SDL_AtomicAdd(&pool->slots, 1) + 1;
+    unsigned seen = 0;
+    for (;;) {
+        SDL_LockMutex(pool->lock);
+        while (pool->generation == seen && !pool->quit)
+            SDL_CondWait(pool->start, pool->lock);
+        if (pool->quit) {
+            SDL_UnlockMutex(pool->lock);
+            return 0;
+        }
+        seen = pool->generation;
+        SDL_UnlockMutex(pool->lock);
+
+        runJobs(pool, slot);
+
+        SDL_LockMutex(pool->lock);
+        if (--pool->running == 0)
+            SDL_CondSignal(pool->done);
+        SDL_UnlockMutex(pool->lock);
     }
-    SDL_Window *window = SDL_CreateWindow("Dodecahedron",
-                                          SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED,
-                                          WINDOW_WIDTH, WINDOW_HEIGHT, SDL_WINDOW_SHOWN);
-    if (!window) {
-        fprintf(stderr, "SDL_CreateWindow Error: %s\n", SDL_GetError());
-        SDL_Quit();
-        return 1;
+}
+
+int poolInit(WorkerPool *pool, int threads) {
+    memset(pool, 0, sizeof(*pool));
+    pool->lock = SDL_CreateMutex();
+    pool->start = SDL_CreateCond();
+    pool->done = SDL_CreateCond();
+    if (!pool->lock || !pool->start || !pool->done)
+        return -1;
+    int workers = threads - 1;
+    if (workers > 64) workers = 64;
+    for (int i = 0; i < workers; i++) {
+        pool->threads[i] = SDL_CreateThread(workerMain, "tile-worker", pool);
+        if (!pool->threads[i])
+            break;
+        pool->numWorkers++;
     }
-    SDL_Renderer *renderer = SDL_CreateRenderer(window, -1,
-                               SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC);
-    if (!renderer) {
-        fprintf(stderr, "SDL_CreateRenderer Error: %s\n", SDL_GetError());
-        SDL_DestroyWindow(window);
-        SDL_Quit();
-        return 1;
+    return 0;
+}
+
+void poolDestroy(WorkerPool *pool) {
+    SDL_LockMutex(pool->lock);
+    pool->quit = 1;
+    SDL_CondBroadcast(pool->start);
+    SDL_UnlockMutex(pool->lock);
+    for (int i = 0; i < pool->numWorkers; i++)
+        SDL_WaitThread(pool->threads[i], NULL);
+    SDL_DestroyCond(pool->done);
+    SDL_DestroyCond(pool->start);
+    SDL_DestroyMutex(pool->lock);
+}
+
+// Runs fn(arg, 0..count-1) across the pool and returns when all are done
+static void poolRun(WorkerPool *pool, JobFn fn, void *arg, int count) {
+    pool->fn = fn;
+    pool->arg = arg;
+    pool->count = count;
+    SDL_AtomicSet(&pool->next, 0);
+    if (pool->numWorkers == 0 || count <= 1) {
+        runJobs(pool, 0);
+        return;
     }
-    SDL_Texture *texture = SDL_CreateTexture(renderer,
-                         SDL_PIXELFORMAT_ARGB8888,
-                         SDL_TEXTUREACCESS_STREAMING,
-                         WINDOW_WIDTH, WINDOW_HEIGHT);
-    if (!texture) {
-        fprintf(stderr, "SDL_CreateTexture Error: %s\n", SDL_GetError());
-        SDL_DestroyRenderer(renderer);
-        SDL_DestroyWindow(window);
-        SDL_Quit();
-        return 1;
+    SDL_LockMutex(pool->lock);
+    pool->running = pool->numWorkers;
+    pool->generation++;
+    SDL_CondBroadcast(pool->start);
+    SDL_UnlockMutex(pool->lock);
+
+    runJobs(pool, 0);
+
+    SDL_LockMutex(pool->lock);
+    while (pool->running > 0)
+        SDL_CondWait(pool->done, pool->lock);
+    SDL_UnlockMutex(pool->lock);
+}
+
+// Slab test against the plane set, returns the entry face or FACE_MISS
+static uint8_t traceRay(const Plane *planes, int numPlanes, Vec3 origin, Vec3 dir,
+                        double *tNearOut, double *tFarOut) {
+    double tNear = -1e9;
+    double tFar  =  1e9;
+    int activePlaneIndex = -1;
+    for (int i = 0; i < numPlanes; i++) {
+        double denom = dot(planes[i].n, dir);
+        if (fabs(denom) < TOL)
+            continue;
+        double t = (planes[i].d - dot(planes[i].n, origin)) / denom;
+        if (denom < 0) {
+            if (t > tNear) {
+                tNear = t;
+                activePlaneIndex = i;
+            }
+        } else {
+            if (t < tFar)
+                tFar = t;
+        }
     }
+    if (tNearOut) *tNearOut = tNear;
+    if (tFarOut) *tFarOut = tFar;
+    if (tNear > tFar || tFar < 0)
+        return FACE_MISS;
+    return (activePlaneIndex >= 0) ? (uint8_t)activePlaneIndex : FACE_INSIDE;
+}
 
-    uint32_t *pixels = malloc(WINDOW_WIDTH * WINDOW_HEIGHT * sizeof(uint32_t));
-    if (!pixels) {
-        fprintf(stderr, "Failed to allocate pixel buffer\n");
-        SDL_DestroyTexture(texture);
-        SDL_DestroyRenderer(renderer);
-        SDL_DestroyWindow(window);
-        SDL_Quit();
-        return 1;
+// traceRay for callers that only want a hit nearer than tMax: the same
+// arithmetic, but it stops as soon as the ray has missed or can only enter
+// at tMax or beyond, since tNear never falls and tFar never rises. Returns
+// FACE_MISS for those, else as traceRay.
+static uint8_t traceRayBefore(const Plane *planes, int numPlanes, Vec3 origin, Vec3 dir, double tMax,
+                              double *tNearOut) {
+    double tNear = -1e9;
+    double tFar  =  1e9;
+    int activePlaneIndex = -1;
+    for (int i = 0; i < numPlanes; i++) {
+        double denom = dot(planes[i].n, dir);
+        if (fabs(denom) < TOL)
+            continue;
+        double t = (planes[i].d - dot(planes[i].n, origin)) / denom;
+        if (denom < 0) {
+            if (t > tNear) {
+                tNear = t;
+                activePlaneIndex = i;
+            }
+        } else {
+            if (t < tFar)
+                tFar = t;
+        }
+        if (tNear > tFar || tFar < 0 || tNear >= tMax)
+            break;
     }
+    *tNearOut = tNear;
+    if (tNear > tFar || tFar < 0 || tNear >= tMax)
+        return FACE_MISS;
+    return (activePlaneIndex >= 0) ? (uint8_t)activePlaneIndex : FACE_INSIDE;
+}
 
-    double modelScale = 0.5;
-    Vec3 scaledVertices[NUM_VERTICES];
-    for (int i = 0; i < NUM_VERTICES; i++) {
-        scaledVertices[i] = scale(baseVertices[i], modelScale);
+#define RAY_BLOCK 64
+
+// SoA version of traceRay with the same arithmetic, so results match it bit
+// for bit as long as neither gets its dot products fused into FMAs (build
+// with -ffp-contract=off; --bench-rays checks). Planes are the outer loop and
+// the per-ray updates are branch-free selects, which lets the compiler
+// vectorize across rays.
+void traceRays(const Plane *planes, int numPlanes, const RayBatch *batch) {
+    for (int base = 0; base < batch->count; base += RAY_BLOCK) {
+        int n = (batch->count - base < RAY_BLOCK) ? batch->count - base : RAY_BLOCK;
+        const double *restrict ox = batch->ox + base, *restrict oy = batch->oy + base, *restrict oz = batch->oz + base;
+        const double *restrict dx = batch->dx + base, *restrict dy = batch->dy + base, *restrict dz = batch->dz + base;
+        double tNear[RAY_BLOCK], tFar[RAY_BLOCK];
+        int32_t face[RAY_BLOCK], exitFace[RAY_BLOCK];
+        for (int k = 0; k < n; k++) {
+            tNear[k] = -1e9;
+            tFar[k] = 1e9;
+            face[k] = -1;
+            exitFace[k] = -1;
+        }
+        for (int i = 0; i < numPlanes; i++) {
+            double nx = planes[i].n.x, ny = planes[i].n.y, nz = planes[i].n.z, d = planes[i].d;
+            for (int k = 0; k < n; k++) {
+                double denom = nx * dx[k] + ny * dy[k] + nz * dz[k];
+                double t = (d - (nx * ox[k] + ny * oy[k] + nz * oz[k])) / denom;
+                int valid = fabs(denom) >= TOL;
+                int enter = valid & (denom < 0) & (t > tNear[k]);
+                int leave = valid & (denom >= 0) & (t < tFar[k]);
+                tNear[k] = enter ? t : tNear[k];
+                face[k] = enter ? i : face[k];
+                tFar[k] = leave ? t : tFar[k];
+                exitFace[k] = leave ? i : exitFace[k];
+            }
+        }
+        for (int k = 0; k < n; k++) {
+            batch->tNear[base + k] = tNear[k];
+            batch->tFar[base + k] = tFar[k];
+            if (tNear[k] > tFar[k] || tFar[k] < 0)
+                batch->face[base + k] = FACE_MISS;
+            else
+                batch->face[base + k] = (face[k] >= 0) ? (uint8_t)face[k] : FACE_INSIDE;
+            if (batch->exitFace)
+                batch->exitFace[base + k] = (exitFace[k] >= 0) ? (uint8_t)exitFace[k] : FACE_INSIDE;
+        }
     }
+}
 
-    Plane basePlanes[MAX_PLANES];
-    int numPlanes = computeBasePlanes(scaledVertices, NUM_VERTICES, basePlanes, MAX_PLANES);
-    if (numPlanes != 12) {
-        printf("Warning: Expected 12 planes, but got %d\n", numPlanes);
+// Same plane test computeBasePlanes uses for the hull, vectorized across points
+void classifyPoints(const Plane *planes, int numPlanes, const PointBatch *batch) {
+    for (int base = 0; base < batch->count; base += RAY_BLOCK) {
+        int n = (batch->count - base < RAY_BLOCK) ? batch->count - base : RAY_BLOCK;
+        const double *restrict px = batch->px + base, *restrict py = batch->py + base, *restrict pz = batch->pz + base;
+        double dist[RAY_BLOCK];
+        for (int k = 0; k < n; k++)
+            dist[k] = -1e9;
+        for (int i = 0; i < numPlanes; i++) {
+            double nx = planes[i].n.x, ny = planes[i].n.y, nz = planes[i].n.z, d = planes[i].d;
+            for (int k = 0; k < n; k++) {
+                double side = nx * px[k] + ny * py[k] + nz * pz[k] - d;
+                dist[k] = side > dist[k] ? side : dist[k];
+            }
+        }
+        for (int k = 0; k < n; k++) {
+            batch->cls[base + k] = dist[k] > TOL ? POINT_OUTSIDE : (dist[k] < -TOL ? POINT_INSIDE : POINT_ON_SURFACE);
+            if (batch->dist)
+                batch->dist[base + k] = dist[k];
+        }
     }
+}
 
-    Vec3 camPos = { 0, 0, -5 };
-    double scaleFactor = 300.0;  // Screen-space scaling (I'm Lazy)
-    double halfWidth = WINDOW_WIDTH / 2.0;
-    double halfHeight = WINDOW_HEIGHT / 2.0;
+static uint32_t shade(Vec3 surfNormal, Vec3 lightDir) {
+    double diff = dot(surfNormal, lightDir);
+    if (diff < 0) diff = 0;
+    int c = (int)(diff * 255);
+    if (c > 255) c = 255;
+    return 0x000000 | (c << 16) | (c << 8) | c; // light R, G, B flickers when changed idk why
+}
 
-    Vec3 lightDir = normalize((Vec3){ 1, 1, -1 });
+static void buildFaceColors(const Plane *planes, int numPlanes, Vec3 lightDir, uint32_t *faceColor) {
+    for (int i = 0; i < 256; i++)
+        faceColor[i] = BG_COLOR;
+    for (int i = 0; i < numPlanes; i++)
+        faceColor[i] = shade(planes[i].n, lightDir);
+    faceColor[FACE_INSIDE] = shade((Vec3){0, 0, 1}, lightDir);
+}
 
-    Uint32 frameCount = 0;
-    Uint32 lastDebugTime = SDL_GetTicks();
+static uint32_t lerpColor(uint32_t a, uint32_t b, double t) {
+    uint32_t out = 0;
+    for (int shift = 16; shift >= 0; shift -= 8) {
+        double ca = (a >> shift) & 0xFF, cb = (b >> shift) & 0xFF;
+        out |= (uint32_t)(ca + (cb - ca) * t + 0.5) << shift;
+    }
+    return out;
+}
 
-    int running = 1;
-    SDL_Event event;
-    while (running) {
-        while (SDL_PollEvent(&event)) {
-            if (event.type == SDL_QUIT)
-                running = 0;
+// Makes sure bg->pixels is a width x height layer, rebuilding it if needed
+static int ensureBackground(Background *bg, int width, int height) {
+    if (bg->pixels && !bg->dirty && bg->width == width && bg->height == height)
+        return 0;
+    uint32_t *pixels = realloc(bg->pixels, sizeof(uint32_t) * width * height);
+    if (!pixels)
+        return -1;
+    bg->pixels = pixels;
+    bg->width = width;
+    bg->height = height;
+    bg->dirty = 0;
+
+    SDL_Surface *img = NULL;
+    if (bg->kind == BG_IMAGE) {
+        SDL_Surface *loaded = SDL_LoadBMP(bg->path);
+        img = loaded ? SDL_ConvertSurfaceFormat(loaded, SDL_PIXELFORMAT_ARGB8888, 0) : NULL;
+        if (loaded)
+            SDL_FreeSurface(loaded);
+        if (!img) {
+            fprintf(stderr, "Failed to load background %s: %s\n", bg->path, SDL_GetError());
+            bg->kind = BG_SOLID;
+        }
+    }
+    for (int y = 0; y < height; y++) {
+        uint32_t *row = &pixels[y * width];
+        if (bg->kind == BG_IMAGE) {
+            const uint32_t *src = (const uint32_t *)((const uint8_t *)img->pixels + (y * img->h / height) * img->pitch);
+            for (int x = 0; x < width; x++)
+                row[x] = src[x * img->w / width] & 0xFFFFFF;
+        } else {
+            uint32_t c = (bg->kind == BG_GRADIENT)
+                ? lerpColor(bg->top, bg->bottom, height > 1 ? (double)y / (height - 1) : 0)
+                : bg->color;
+            for (int x = 0; x < width; x++)
+                row[x] = c;
         }
+    }
+    if (img)
+        SDL_FreeSurface(img);
+    return 0;
+}
 
-        Uint32 currentTime = SDL_GetTicks();
-        double angle = currentTime / 1000.0;
+// Writes the colors for faceIds[y][x0..x1): hits from the face color table,
+// runs of misses as one block copy from the background layer
+static void resolveRow(const RenderContext *ctx, int y, int x0, int x1) {
+    const Frame *frame = ctx->frame;
+    const uint8_t *ids = &frame->faceIds[y * frame->width];
+    const uint32_t *bg = &ctx->background[y * frame->width];
+    uint32_t *out = &frame->pixels[y * frame->width];
+    int x = x0;
+    while (x < x1) {
+        if (ids[x] == FACE_MISS) {
+            int start = x;
+            while (x < x1 && ids[x] == FACE_MISS)
+                x++;
+            memcpy(out + start, bg + start, sizeof(uint32_t) * (x - start));
+        } else {
+            out[x] = ctx->faceColor[ids[x]];
+            x++;
+        }
+    }
+}
 
-        // d should now remain unchanged
-        Plane rotatedPlanes[MAX_PLANES];
-        for (int i = 0; i < numPlanes; i++) {
-            rotatedPlanes[i].n = rotate(basePlanes[i].n, angle);
-            rotatedPlanes[i].d = basePlanes[i].d;
+static uint32_t sampleColor(const RenderContext *ctx, uint8_t face, int pixel) {
+    return (face == FACE_MISS) ? ctx->background[pixel] : ctx->faceColor[face];
+}
+
+static Vec3 pixelRay(const RenderContext *ctx, double x, double y) {
+    double u = (x - ctx->halfWidth) / ctx->scaleFactor;
+    double v = (ctx->halfHeight - y) / ctx->scaleFactor;
+    return normalize(add(add(scale(ctx->camRight, u), scale(ctx->camUp, v)), scale(ctx->camForward, 5)));
+}
+
+// Points the camera at target; up only has to be roughly right
+static void setCamera(RenderContext *ctx, Vec3 pos, Vec3 target, Vec3 up) {
+    ctx->camPos = pos;
+    ctx->camForward = normalize(subtract(target, pos));
+    ctx->camRight = normalize(cross(up, ctx->camForward));
+    ctx->camUp = cross(ctx->camForward, ctx->camRight);
+}
+
+// Resolution step for the 4x4 block whose top-left corner is (bx, by)
+static int foveaStep(const RenderContext *ctx, int bx, int by) {
+    if (ctx->fovea.innerRadius <= 0)
+        return 1;
+    double dx = bx + 2 - ctx->halfWidth;
+    double dy = by + 2 - ctx->halfHeight;
+    double r2 = dx * dx + dy * dy;
+    if (r2 < (double)ctx->fovea.innerRadius * ctx->fovea.innerRadius)
+        return 1;
+    if (r2 < (double)ctx->fovea.outerRadius * ctx->fovea.outerRadius)
+        return 2;
+    return 4;
+}
+
+// Tile-local memo of traced samples, one extra row/column so coarse cells
+// can look at the corners they share with the next tile
+typedef struct {
+    const RenderContext *ctx;
+    int x0, y0;
+    int traced;
+    uint8_t ids[(TILE_SIZE + 1) * (TILE_SIZE + 1)];
+} TileSamples;
+
+static uint8_t sampleFace(TileSamples *ts, int x, int y) {
+    const RenderContext *ctx = ts->ctx;
+    if (x >= ctx->frame->width) x = ctx->frame->width - 1;
+    if (y >= ctx->frame->height) y = ctx->frame->height - 1;
+    uint8_t *slot = &ts->ids[(y - ts->y0) * (TILE_SIZE + 1) + (x - ts->x0)];
+    if (*slot == FACE_UNTRACED) {
+        *slot = traceRay(ctx->planes, ctx->numPlanes, ctx->camPos, pixelRay(ctx, x, y), NULL, NULL);
+        ts->traced++;
+    }
+    return *slot;
+}
+
+// X-ray and absorption both come from the one slab test: the exit face and
+// chord length tFar - tNear are already there, so no extra rays or sorting
+static void resolveRowTranslucent(const RenderContext *ctx, int y, int x0, int x1,
+                                  const double *tNear, const double *tFar, const uint8_t *exitFace) {
+    const Translucency *tr = ctx->translucency;
+    const Frame *frame = ctx->frame;
+    const uint8_t *ids = &frame->faceIds[y * frame->width];
+    const uint32_t *bg = &ctx->background[y * frame->width];
+    uint32_t *out = &frame->pixels[y * frame->width];
+    for (int x = x0; x < x1; x++) {
+        int k = x - x0;
+        if (ids[x] == FACE_MISS) {
+            out[x] = bg[x];
+            continue;
+        }
+        uint32_t front = ctx->faceColor[ids[x]], back = ctx->faceColor[exitFace[k]];
+        double chord = tFar[k] - (tNear[k] > 0 ? tNear[k] : 0);
+        uint32_t c = 0;
+        for (int shift = 16; shift >= 0; shift -= 8) {
+            double b = (bg[x] >> shift) & 0xFF;
+            double v;
+            if (tr->mode == TRANSLUCENT_XRAY) {
+                double f = (front >> shift) & 0xFF, e = (back >> shift) & 0xFF;
+                v = tr->alpha * f + (1 - tr->alpha) * (tr->alpha * e + (1 - tr->alpha) * b);
+            } else {
+                v = b * exp(-tr->sigma[2 - shift / 8] * chord);
+            }
+            c |= (uint32_t)(v + 0.5) << shift;
+        }
+        out[x] = c;
+    }
+}
+
+// Full resolution tiles trace each row as one SoA batch through traceRays()
+static int renderTileBatch(const RenderContext *ctx, int x0, int y0, int x1, int y1) {
+    Frame *frame = ctx->frame;
+    double ox[TILE_SIZE], oy[TILE_SIZE], oz[TILE_SIZE];
+    double dx[TILE_SIZE], dy[TILE_SIZE], dz[TILE_SIZE];
+    double tNear[TILE_SIZE], tFar[TILE_SIZE];
+    uint8_t exitFace[TILE_SIZE];
+    RayBatch batch = { ox, oy, oz, dx, dy, dz, tNear, tFar, NULL, x1 - x0,
+                       ctx->translucency ? exitFace : NULL };
+    for (int k = 0; k < batch.count; k++) {
+        ox[k] = ctx->camPos.x;
+        oy[k] = ctx->camPos.y;
+        oz[k] = ctx->camPos.z;
+    }
+    for (int y = y0; y < y1; y++) {
+        for (int x = x0; x < x1; x++) {
+            Vec3 rayDir = pixelRay(ctx, x, y);
+            dx[x - x0] = rayDir.x;
+            dy[x - x0] = rayDir.y;
+            dz[x - x0] = rayDir.z;
         }
+        batch.face = &frame->faceIds[y * frame->width + x0];
+        traceRays(ctx->planes, ctx->numPlanes, &batch);
+        if (ctx->translucency)
+            resolveRowTranslucent(ctx, y, x0, x1, tNear, tFar, exitFace);
+        else
+            resolveRow(ctx, y, x0, x1);
+    }
+    return (x1 - x0) * (y1 - y0);
+}
+
+// Renders one tile and returns the number of rays it traced. Coarse cells
+// are filled from their corner samples when all four see the same face and
+// traced per pixel otherwise, which also keeps ring boundaries seam free.
+static int renderTile(const RenderContext *ctx, int x0, int y0, int x1, int y1) {
+    if ((ctx->fovea.innerRadius <= 0 && !ctx->scalarKernel) || ctx->translucency)
+        return renderTileBatch(ctx, x0, y0, x1, y1);
 
-        // for each pixel cast a ray and test intersection with the convex polyhedron
-        for (int y = 0; y < WINDOW_HEIGHT; y++) {
-            for (int x = 0; x < WINDOW_WIDTH; x++) {
-                double u = (x - halfWidth) / scaleFactor;
-                double v = (halfHeight - y) / scaleFactor;
-                Vec3 rayDir = normalize((Vec3){ u, v, 5 });
-
-                double tNear = -1e9;
-                double tFar  =  1e9;
-                int activePlaneIndex = -1;
-                for (int i = 0; i < numPlanes; i++) {
-                    double denom = dot(rotatedPlanes[i].n, rayDir);
-                    if (fabs(denom) < TOL)
-                        continue;
-                    double t = (rotatedPlanes[i].d - dot(rotatedPlanes[i].n, camPos)) / denom;
-                    if (denom < 0) {
-                        if (t > tNear) {
-                            tNear = t;
-                            activePlaneIndex = i;
-                        }
-                    } else {
-                        if (t < tFar)
-                            tFar = t;
+    TileSamples ts;
+    ts.ctx = ctx;
+    ts.x0 = x0;
+    ts.y0 = y0;
+    ts.traced = 0;
+    memset(ts.ids, FACE_UNTRACED, sizeof(ts.ids));
+
+    Frame *frame = ctx->frame;
+    for (int by = y0; by < y1; by += 4) {
+        for (int bx = x0; bx < x1; bx += 4) {
+            int step = foveaStep(ctx, bx, by);
+            for (int cy = by; cy < by + 4 && cy < y1; cy += step) {
+                for (int cx = bx; cx < bx + 4 && cx < x1; cx += step) {
+                    int ex = (cx + step < x1) ? cx + step : x1;
+                    int ey = (cy + step < y1) ? cy + step : y1;
+                    int uniform = 0;
+                    uint8_t id = sampleFace(&ts, cx, cy);
+                    if (step > 1) {
+                        uniform = sampleFace(&ts, cx + step, cy) == id &&
+                                  sampleFace(&ts, cx, cy + step) == id &&
+                                  sampleFace(&ts, cx + step, cy + step) == id;
+                    }
+                    for (int y = cy; y < ey; y++) {
+                        for (int x = cx; x < ex; x++)
+                            frame->faceIds[y * frame->width + x] = uniform ? id : sampleFace(&ts, x, y);
                     }
                 }
-                if (tNear > tFar || tFar < 0) {
-                    pixels[y * WINDOW_WIDTH + x] = 0x00FF00; // bg R, G, B Currently: Green
-                    continue;
-                }
-                double tHit = (tNear >= 0) ? tNear : tFar;
-                Vec3 hitPoint = add(camPos, scale(rayDir, tHit));
+            }
+        }
+    }
+    for (int y = y0; y < y1; y++)
+        resolveRow(ctx, y, x0, x1);
+    return ts.traced;
+}
+
+static uint16_t octEncode(Vec3 n) {
+    double s = fabs(n.x) + fabs(n.y) + fabs(n.z);
+    double x = n.x / s, y = n.y / s;
+    if (n.z < 0) {
+        double ox = x;
+        x = (1 - fabs(y)) * (x >= 0 ? 1 : -1);
+        y = (1 - fabs(ox)) * (y >= 0 ? 1 : -1);
+    }
+    int8_t ex = (int8_t)lrint(x * 127), ey = (int8_t)lrint(y * 127);
+    return (uint16_t)((uint8_t)ex | ((uint8_t)ey << 8));
+}
+
+static uint16_t floatToHalf(float f) {
+    uint32_t bits;
+    memcpy(&bits, &f, sizeof(bits));
+    uint16_t sign = (bits >> 16) & 0x8000;
+    int exp = (int)((bits >> 23) & 0xFF) - 127 + 15;
+    uint32_t mant = bits & 0x7FFFFF;
+    if (exp <= 0)
+        return sign; // flush tiny values to zero
+    if (exp >= 31)
+        return sign | 0x7C00;
+    return sign | (uint16_t)(exp << 10) | (uint16_t)((mant + 0x1000) >> 13);
+}
 
-                Vec3 surfNormal = (activePlaneIndex >= 0) ? rotatedPlanes[activePlaneIndex].n : (Vec3){0, 0, 1};
-                double diff = dot(surfNormal, lightDir);
-                if (diff < 0) diff = 0;
-                int c = (int)(diff * 255);
-                if (c > 255) c = 255;
-                uint32_t color = 0x000000 | (c << 16) | (c << 8) | c; // light R, G, B flickers when changed idk why
-                pixels[y * WINDOW_WIDTH + x] = color;
+// Fills the AOVs for one tile from its face IDs. Hits on a known face get t
+// from the plane equation, so coarse foveated cells need no extra rays.
+static void writeTileAov(const RenderContext *ctx, int x0, int y0, int x1, int y1) {
+    AovBuffers *aov = ctx->aov;
+    const Frame *frame = ctx->frame;
+    float depthScale = 0xFFFE / (aov->header->depthFar - aov->header->depthNear);
+    for (int y = y0; y < y1; y++) {
+        for (int x = x0; x < x1; x++) {
+            int i = y * frame->width + x;
+            uint8_t f = frame->faceIds[i];
+            if (f == FACE_MISS) {
+                aov->depth[i] = AOV_DEPTH_MISS;
+                aov->normal[i] = 0;
+                aov->position[3 * i] = aov->position[3 * i + 1] = aov->position[3 * i + 2] = 0;
+                continue;
+            }
+            Vec3 rayDir = pixelRay(ctx, x, y);
+            double tHit;
+            Vec3 surfNormal;
+            if (f < ctx->numPlanes) {
+                const Plane *p = &ctx->planes[f];
+                tHit = (p->d - dot(p->n, ctx->camPos)) / dot(p->n, rayDir);
+                surfNormal = p->n;
+            } else {
+                double tNear, tFar;
+                traceRay(ctx->planes, ctx->numPlanes, ctx->camPos, rayDir, &tNear, &tFar);
+                tHit = (tNear >= 0) ? tNear : tFar;
+                surfNormal = (Vec3){0, 0, 1};
             }
+            Vec3 hitPoint = add(ctx->camPos, scale(rayDir, tHit));
+            float d = ((float)tHit - aov->header->depthNear) * depthScale;
+            aov->depth[i] = (uint16_t)(d < 0 ? 0 : (d > 0xFFFE ? 0xFFFE : d));
+            aov->normal[i] = octEncode(surfNormal);
+            aov->position[3 * i + 0] = floatToHalf((float)hitPoint.x);
+            aov->position[3 * i + 1] = floatToHalf((float)hitPoint.y);
+            aov->position[3 * i + 2] = floatToHalf((float)hitPoint.z);
         }
+    }
+}
 
-        SDL_UpdateTexture(texture, NULL, pixels, WINDOW_WIDTH * sizeof(uint32_t));
-        SDL_RenderClear(renderer);
-        SDL_RenderCopy(renderer, texture, NULL, NULL);
-        SDL_RenderPresent(renderer);
+static uint32_t hash32(uint32_t x) {
+    x ^= x >> 16;
+    x *= 0x7FEB352Du;
+    x ^= x >> 15;
+    x *= 0x846CA68Bu;
+    x ^= x >> 16;
+    return x;
+}
 
-        frameCount++;
-        if (currentTime - lastDebugTime >= 1000) {
-            double fps = frameCount * 1000.0 / (currentTime - lastDebugTime);
-            printf("FPS: %.2f | Angle: %.2f rad | Frames: %u | Planes: %d\n", fps, angle, frameCount, numPlanes);
-            lastDebugTime = currentTime;
-            frameCount = 0;
+static uint32_t reverseBits(uint32_t x) {
+    x = (x << 16) | (x >> 16);
+    x = ((x & 0x00FF00FFu) << 8) | ((x & 0xFF00FF00u) >> 8);
+    x = ((x & 0x0F0F0F0Fu) << 4) | ((x & 0xF0F0F0F0u) >> 4);
+    x = ((x & 0x33333333u) << 2) | ((x & 0xCCCCCCCCu) >> 2);
+    x = ((x & 0x55555555u) << 1) | ((x & 0xAAAAAAAAu) >> 1);
+    return x;
+}
+
+// First two Sobol dimensions, padded to higher dimensions by giving every
+// (pixel, dimension pair) its own random digit scramble
+static void sobolSample(uint32_t index, uint32_t pixel, uint32_t pair, double out[2]) {
+    uint32_t a = reverseBits(index), b = 0;
+    for (uint32_t v = 1u << 31, i = index; i; i >>= 1, v ^= v >> 1)
+        if (i & 1) b ^= v;
+    uint32_t seed = hash32(pixel * 0x9E3779B9u + pair);
+    out[0] = (a ^ seed) * (1.0 / 4294967296.0);
+    out[1] = (b ^ hash32(seed)) * (1.0 / 4294967296.0);
+}
+
+// Sky gradient over a dark ground, plus the sun as a directional light
+static Vec3 environment(Vec3 dir) {
+    if (dir.y < 0)
+        return (Vec3){ 0.12, 0.11, 0.10 };
+    double t = dir.y;
+    return (Vec3){ 0.55 + 0.25 * t, 0.7 + 0.15 * t, 0.95 };
+}
+
+static Vec3 mul(Vec3 a, Vec3 b) {
+    return (Vec3){ a.x * b.x, a.y * b.y, a.z * b.z };
+}
+
+static Vec3 pathTraceSample(const RenderContext *ctx, double px, double py, uint32_t pixel, uint32_t index) {
+    const PathTracer *pt = ctx->pt;
+    const Vec3 albedo = { 0.8, 0.78, 0.75 };
+    const Vec3 sun = { 3.0, 2.85, 2.7 };
+    Vec3 origin = ctx->camPos;
+    Vec3 dir = pixelRay(ctx, px, py);
+    Vec3 radiance = { 0, 0, 0 }, throughput = { 1, 1, 1 };
+    for (int bounce = 0; bounce <= pt->maxBounces; bounce++) {
+        double tNear, tFar;
+        uint8_t f = traceRay(ctx->planes, ctx->numPlanes, origin, dir, &tNear, &tFar);
+        if (f == FACE_MISS || (tNear < 1e-7 && tFar < 1e-7)) {
+            radiance = add(radiance, mul(throughput, environment(dir)));
+            break;
         }
-        SDL_Delay(1);
+        double tHit = (tNear >= 1e-7) ? tNear : tFar;
+        Vec3 n = (f < ctx->numPlanes) ? ctx->planes[f].n : (Vec3){0, 0, 1};
+        if (dot(n, dir) > 0)
+            n = scale(n, -1);
+        Vec3 hit = add(origin, scale(dir, tHit));
+        origin = add(hit, scale(n, 1e-6));
+        throughput = mul(throughput, albedo);
+
+        // next event estimation toward the sun, shadowed by the same plane test
+        double cosL = dot(n, pt->lightDir);
+        if (cosL > 0) {
+            uint8_t blocker = traceRay(ctx->planes, ctx->numPlanes, origin, pt->lightDir, &tNear, &tFar);
+            if (blocker == FACE_MISS || tFar < 1e-7)
+                radiance = add(radiance, scale(mul(throughput, sun), cosL));
+        }
+
+        // cosine-weighted bounce
+        double u[2];
+        sobolSample(index, pixel, 1 + bounce, u);
+        double r = sqrt(u[0]), phi = 2 * M_PI * u[1];
+        Vec3 helper = (fabs(n.x) < 0.9) ? (Vec3){1, 0, 0} : (Vec3){0, 1, 0};
+        Vec3 tx = normalize(cross(helper, n));
+        Vec3 ty = cross(n, tx);
+        dir = normalize(add(add(scale(tx, r * cos(phi)), scale(ty, r * sin(phi))), scale(n, sqrt(1 - u[0]))));
     }
+    return radiance;
+}
 
-    free(pixels);
-    SDL_DestroyTexture(texture);
-    SDL_DestroyRenderer(renderer);
-    SDL_DestroyWindow(window);
-    SDL_Quit();
+static uint32_t tonemap(const float *rgb, float invSamples) {
+    uint32_t out = 0;
+    for (int c = 0; c < 3; c++) {
+        float v = rgb[c] * invSamples;
+        v = v / (1 + v);                     // Reinhard
+        int q = (int)(powf(v, 1 / 2.2f) * 255 + 0.5f);
+        out = (out << 8) | (uint32_t)(q > 255 ? 255 : q);
+    }
+    return out;
+}
+
+static Vec3 equirectDir(int x, int y, int w, int h) {
+    double phi = 2 * M_PI * (x + 0.5) / w - M_PI;
+    double theta = M_PI * (y + 0.5) / h;
+    return (Vec3){ sin(theta) * cos(phi), cos(theta), sin(theta) * sin(phi) };
+}
+
+static void shBasis(Vec3 d, float *y) {
+    y[0] = 0.282095f;
+    y[1] = 0.488603f * (float)d.y;
+    y[2] = 0.488603f * (float)d.z;
+    y[3] = 0.488603f * (float)d.x;
+    y[4] = 1.092548f * (float)(d.x * d.y);
+    y[5] = 1.092548f * (float)(d.y * d.z);
+    y[6] = 0.315392f * (float)(3 * d.z * d.z - 1);
+    y[7] = 1.092548f * (float)(d.x * d.z);
+    y[8] = 0.546274f * (float)(d.x * d.x - d.y * d.y);
+}
+
+// Diffuse irradiance from the SH coefficients (Ramamoorthi & Hanrahan)
+static Vec3 shIrradiance(const EnvLighting *env, Vec3 n) {
+    static const float band[9] = { 3.141593f, 2.094395f, 2.094395f, 2.094395f,
+                                   0.785398f, 0.785398f, 0.785398f, 0.785398f, 0.785398f };
+    float y[9], e[3] = { 0, 0, 0 };
+    shBasis(n, y);
+    for (int i = 0; i < 9; i++)
+        for (int c = 0; c < 3; c++)
+            e[c] += band[i] * env->sh[i][c] * y[i];
+    return (Vec3){ e[0] > 0 ? e[0] : 0, e[1] > 0 ? e[1] : 0, e[2] > 0 ? e[2] : 0 };
+}
+
+static Vec3 envLookup(const EnvLighting *env, Vec3 d, int level) {
+    int w = env->mipW[level], h = env->mipH[level];
+    double phi = atan2(d.z, d.x), theta = acos(d.y < -1 ? -1 : (d.y > 1 ? 1 : d.y));
+    int x = (int)((phi + M_PI) / (2 * M_PI) * w), y = (int)(theta / M_PI * h);
+    x = x < 0 ? 0 : (x >= w ? w - 1 : x);
+    y = y < 0 ? 0 : (y >= h ? h - 1 : y);
+    const float *p = &env->mip[level][3 * (y * w + x)];
+    return (Vec3){ p[0], p[1], p[2] };
+}
+
+// Loads a BMP (via SDL) or bakes the procedural sky, projects it into SH and
+// builds the mip chain. Runs once at startup.
+static int envInit(EnvLighting *env, const char *path) {
+    int w = 256, h = 128;
+    SDL_Surface *img = NULL;
+    if (path) {
+        SDL_Surface *loaded = SDL_LoadBMP(path);
+        img = loaded ? SDL_ConvertSurfaceFormat(loaded, SDL_PIXELFORMAT_ARGB8888, 0) : NULL;
+        if (loaded)
+            SDL_FreeSurface(loaded);
+        if (!img) {
+            fprintf(stderr, "Failed to load environment %s: %s\n", path, SDL_GetError());
+            return -1;
+        }
+        w = img->w;
+        h = img->h;
+    }
+    env->mip[0] = malloc(sizeof(float) * 3 * w * h);
+    if (!env->mip[0]) {
+        SDL_FreeSurface(img);
+        return -1;
+    }
+    env->mipW[0] = w;
+    env->mipH[0] = h;
+    for (int y = 0; y < h; y++) {
+        for (int x = 0; x < w; x++) {
+            float *p = &env->mip[0][3 * (y * w + x)];
+            if (img) {
+                uint32_t c = ((const uint32_t *)((const uint8_t *)img->pixels + y * img->pitch))[x];
+                p[0] = powf(((c >> 16) & 0xFF) / 255.0f, 2.2f);
+                p[1] = powf(((c >> 8) & 0xFF) / 255.0f, 2.2f);
+                p[2] = powf((c & 0xFF) / 255.0f, 2.2f);
+            } else {
+                Vec3 L = environment(equirectDir(x, y, w, h));
+                p[0] = (float)L.x;
+                p[1] = (float)L.y;
+                p[2] = (float)L.z;
+            }
+        }
+    }
+    if (img)
+        SDL_FreeSurface(img);
+
+    memset(env->sh, 0, sizeof(env->sh));
+    for (int y = 0; y < h; y++) {
+        double theta = M_PI * (y + 0.5) / h;
+        float dOmega = (float)((2 * M_PI / w) * (M_PI / h) * sin(theta));
+        for (int x = 0; x < w; x++) {
+            float basis[9];
+            shBasis(equirectDir(x, y, w, h), basis);
+            const float *p = &env->mip[0][3 * (y * w + x)];
+            for (int i = 0; i < 9; i++)
+                for (int c = 0; c < 3; c++)
+                    env->sh[i][c] += p[c] * basis[i] * dOmega;
+        }
+    }
+
+    env->numMips = 1;
+    while (env->numMips < ENV_MAX_MIPS && env->mipW[env->numMips - 1] > 1 && env->mipH[env->numMips - 1] > 1) {
+        int l = env->numMips, sw = env->mipW[l - 1], sh = env->mipH[l - 1];
+        int mw = sw / 2, mh = sh / 2;
+        env->mip[l] = malloc(sizeof(float) * 3 * mw * mh);
+        if (!env->mip[l])
+            break;
+        for (int y = 0; y < mh; y++) {
+            for (int x = 0; x < mw; x++) {
+                for (int c = 0; c < 3; c++) {
+                    const float *s = env->mip[l - 1];
+                    env->mip[l][3 * (y * mw + x) + c] = 0.25f *
+                        (s[3 * ((2 * y) * sw + 2 * x) + c] + s[3 * ((2 * y) * sw + 2 * x + 1) + c] +
+                         s[3 * ((2 * y + 1) * sw + 2 * x) + c] + s[3 * ((2 * y + 1) * sw + 2 * x + 1) + c]);
+                }
+            }
+        }
+        env->mipW[l] = mw;
+        env->mipH[l] = mh;
+        env->numMips++;
+    }
     return 0;
 }
+
+static void envFree(EnvLighting *env) {
+    for (int l = 0; l < env->numMips; l++)
+        free(env->mip[l]);
+}
+
+static uint32_t envShade(const EnvLighting *env, Vec3 n) {
+    const float albedo = 0.8f;
+    Vec3 e = shIrradiance(env, n);
+    float rgb[3] = { (float)e.x * albedo, (float)e.y * albedo, (float)e.z * albedo };
+    return tonemap(rgb, env->exposure / (float)M_PI);
+}
+
+// Diffuse IBL only needs one SH evaluation per rotated face normal
+static void buildFaceColorsEnv(const Plane *planes, int numPlanes, const EnvLighting *env, uint32_t *faceColor) {
+    for (int i = 0; i < 256; i++)
+        faceColor[i] = BG_COLOR;
+    for (int i = 0; i < numPlanes; i++)
+        faceColor[i] = envShade(env, planes[i].n);
+    faceColor[FACE_INSIDE] = envShade(env, (Vec3){0, 0, 1});
+}
+
+// Adds the per-pixel specular reflection on top of the diffuse face colors
+static void envSpecularTile(const RenderContext *ctx, int x0, int y0, int x1, int y1) {
+    const EnvLighting *env = ctx->env;
+    Frame *frame = ctx->frame;
+    int level = (int)(env->roughness * (env->numMips - 1) + 0.5f);
+    for (int y = y0; y < y1; y++) {
+        for (int x = x0; x < x1; x++) {
+            int i = y * frame->width + x;
+            uint8_t f = frame->faceIds[i];
+            if (f >= ctx->numPlanes)
+                continue;
+            Vec3 n = ctx->planes[f].n;
+            Vec3 dir = pixelRay(ctx, x, y);
+            double cosV = -dot(n, dir);
+            Vec3 r = subtract(dir, scale(n, 2 * dot(n, dir)));
+            double fresnel = 0.04 + 0.96 * pow(1 - (cosV > 0 ? cosV : 0), 5);
+            Vec3 s = scale(envLookup(env, r, level), fresnel * env->exposure);
+            uint32_t c = frame->pixels[i];
+            int rgb[3] = { (int)((c >> 16) & 0xFF), (int)((c >> 8) & 0xFF), (int)(c & 0xFF) };
+            double add3[3] = { s.x, s.y, s.z };
+            for (int k = 0; k < 3; k++) {
+                int v = rgb[k] + (int)(255 * add3[k] / (1 + add3[k]));
+                rgb[k] = v > 255 ? 255 : v;
+            }
+            frame->pixels[i] = (uint32_t)((rgb[0] << 16) | (rgb[1] << 8) | rgb[2]);
+        }
+    }
+}
+
+static void pathTraceTile(const RenderContext *ctx, int x0, int y0, int x1, int y1) {
+    const PathTracer *pt = ctx->pt;
+    Frame *frame = ctx->frame;
+    if (pt->samples == 0)
+        renderTileBatch(ctx, x0, y0, x1, y1); // face IDs for picking/outlines/AOVs
+    float inv = 1.0f / (pt->samples + pt->sppPerFrame);
+    for (int y = y0; y < y1; y++) {
+        for (int x = x0; x < x1; x++) {
+            uint32_t pixel = (uint32_t)(y * frame->width + x);
+            float *acc = &pt->accum[3 * pixel];
+            for (int s = 0; s < pt->sppPerFrame; s++) {
+                uint32_t index = (uint32_t)(pt->samples + s);
+                double jitter[2];
+                sobolSample(index, pixel, 0, jitter);
+                Vec3 L = pathTraceSample(ctx, x - 0.5 + jitter[0], y - 0.5 + jitter[1], pixel, index);
+                acc[0] += (float)L.x;
+                acc[1] += (float)L.y;
+                acc[2] += (float)L.z;
+            }
+            frame->pixels[pixel] = tonemap(acc, inv);
+        }
+    }
+}
+
+// Advances one tile by a refinement level (or one supersample) unless the
+// frame budget is spent, then resolves its display pixels from the stored
+// face IDs / accumulation so untouched tiles still present correctly.
+static int progressiveTile(const RenderContext *ctx, int tile, int x0, int y0, int x1, int y1) {
+    Progressive *pr = ctx->progressive;
+    Frame *frame = ctx->frame;
+    int w = frame->width;
+    int done = pr->tileStep[tile];
+    int traced = 0;
+    // the 1/8 level is never deferred so something is always on screen
+    int work = done == 0 || (SDL_GetPerformanceCounter() < pr->deadline &&
+                             (done > 1 || pr->tileSamples[tile] < pr->maxSamples));
+    if (work && done != 1) {
+        int step = done ? done / 2 : PROGRESSIVE_START;
+        for (int y = y0; y < y1; y += step) {
+            for (int x = x0; x < x1; x += step) {
+                int coarse = done && ((x - x0) % done) == 0 && ((y - y0) % done) == 0;
+                if (coarse)
+                    continue; // reuse the samples of the previous levels
+                frame->faceIds[y * w + x] = traceRay(ctx->planes, ctx->numPlanes, ctx->camPos,
+                                                     pixelRay(ctx, x, y), NULL, NULL);
+                traced++;
+            }
+        }
+        // fill each cell with its sample, so outlines, AOVs, recordings and
+        // the rest read a whole buffer that matches what is on screen
+        for (int y = y0; step > 1 && y < y1; y++) {
+            const uint8_t *grid = &frame->faceIds[(y0 + (y - y0) / step * step) * w];
+            uint8_t *row = &frame->faceIds[y * w];
+            for (int x = x0; x < x1; x++)
+                row[x] = grid[x0 + (x - x0) / step * step];
+        }
+        done = step;
+        pr->tileStep[tile] = (uint8_t)done;
+        pr->tileSamples[tile] = 0;
+    } else if (work) {
+        // supersampling: sample 0 is the pixel center already in faceIds
+        int s = pr->tileSamples[tile];
+        for (int y = y0; y < y1; y++) {
+            for (int x = x0; x < x1; x++) {
+                uint32_t pixel = (uint32_t)(y * w + x);
+                float *acc = &pr->accum[3 * pixel];
+                if (s == 0) {
+                    uint32_t c = sampleColor(ctx, frame->faceIds[pixel], (int)pixel);
+                    acc[0] = (float)((c >> 16) & 0xFF);
+                    acc[1] = (float)((c >> 8) & 0xFF);
+                    acc[2] = (float)(c & 0xFF);
+                }
+                double jitter[2];
+                sobolSample((uint32_t)s + 1, pixel, 0, jitter);
+                uint8_t f = traceRay(ctx->planes, ctx->numPlanes, ctx->camPos,
+                                     pixelRay(ctx, x - 0.5 + jitter[0], y - 0.5 + jitter[1]), NULL, NULL);
+                uint32_t c = sampleColor(ctx, f, (int)pixel);
+                acc[0] += (float)((c >> 16) & 0xFF);
+                acc[1] += (float)((c >> 8) & 0xFF);
+                acc[2] += (float)(c & 0xFF);
+                traced++;
+            }
+        }
+        pr->tileSamples[tile] = (uint16_t)(s + 1);
+    }
+    if (done > 1 || pr->tileSamples[tile] < pr->maxSamples)
+        SDL_AtomicAdd(&pr->pending, 1);
+
+    int samples = pr->tileSamples[tile];
+    for (int y = y0; y < y1; y++) {
+        if (done > 1 || samples == 0) {
+            resolveRow(ctx, y, x0, x1);
+            continue;
+        }
+        for (int x = x0; x < x1; x++) {
+            int i = y * w + x;
+            const float *acc = &pr->accum[3 * i];
+            float inv = 1.0f / (samples + 1);
+            frame->pixels[i] = ((uint32_t)(acc[0] * inv + 0.5f) << 16) |
+                               ((uint32_t)(acc[1] * inv + 0.5f) << 8) |
+                               (uint32_t)(acc[2] * inv + 0.5f);
+        }
+    }
+    return traced;
+}
+
+/*
+ * Binary scenes. A scene file is meant to be mmap'd and used in place: a
+ * header of section offsets, then plane sets, planes (the in-memory Plane
+ * layout), materials, lights and instances, each section 8-byte aligned
+ * and in native (little-endian) byte order. Opening one is a bounds check,
+ * not a parse. Writers should replace the file by rename; --scene watches
+ * its directory with inotify and swaps the new mapping in between frames.
+ *
+ * Version 2 adds an optional chunk table for scenes too big to keep in
+ * memory: instances sorted into spatially compact, page-aligned runs with
+ * a bounding sphere each. Only chunks in or near the view frustum are
+ * paged in (madvise, checked with mincore), the least recently seen ones
+ * are dropped from the page cache past the budget, and chunks still on
+ * their way are drawn as their bounding sphere.
+ */
+#define SCENE_MAGIC 0x4E435344 // "DSCN"
+#define SCENE_VERSION 2
+#define SCENE_MAX_LIGHTS 8
+#define SCENE_JOB_SIZE 256
+#define SCENE_FAR 48.0         // chunks beyond this depth are not streamed
+#define SCENE_PREFETCH_MS 1000 // read-ahead for where the camera will be this much later
+#define SCENE_RETRY_FRAMES 8   // ask again for chunks still not in after this long
+#define SCENE_READAHEAD (128 << 10) // bytes per WILLNEED, the kernel caps each at its read-ahead size
+#define FIELD_CHUNK 8          // instances per chunk edge in --write-field
+#define HIZ_BLOCK 8            // pixels per texel of the finest occlusion level
+#define HIZ_OCCLUDERS 256
+#define HIZ_MIN_RADIUS 6.0     // px; smaller silhouettes hardly cover a block
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t numPlaneSets, numPlanes, numMaterials, numLights;
+    uint32_t numInstances, numChunks; // numChunks is 0 in version 1
+    uint64_t planeSetOffset, planeOffset, materialOffset, lightOffset, instanceOffset;
+    uint64_t chunkOffset; // version 2
+} SceneHeader;
+
+typedef struct {
+    uint32_t firstPlane, numPlanes;
+    double radius; // bounding sphere about the origin at scale 1
+} ScenePlaneSet;
+
+typedef struct {
+    uint32_t color; // 0xRRGGBB
+    float ambient;
+} SceneMaterial;
+
+typedef struct {
+    Vec3 dir; // unit vector towards the light
+    double intensity;
+} SceneLight;
+
+typedef struct {
+    Vec3 position;
+    double scale;
+    double spin, phase; // oriented as rotate(n, spin * angle + phase)
+    uint32_t planeSet, material;
+} SceneInstance;
+
+typedef struct {
+    uint32_t firstInstance, numInstances;
+    Vec3 center;
+    double radius;  // holds the bounding sphere of every instance in the chunk
+    uint32_t color; // average material color, for the impostor
+    uint32_t reserved;
+} SceneChunk;
+
+enum { CHUNK_COLD, CHUNK_REQUESTED, CHUNK_RESIDENT, CHUNK_BAD };
+
+typedef struct {
+    const SceneHeader *header;
+    const ScenePlaneSet *planeSets;
+    const Plane *planes;
+    const SceneMaterial *materials;
+    const SceneLight *lights;
+    const SceneInstance *instances;
+    const SceneChunk *chunks;
+    int numChunks;
+    void *map;
+    size_t size;
+    int fd;                // kept for chunked scenes, to drop evicted chunks from the page cache
+    uint8_t *chunkState;   // CHUNK_*
+    uint32_t *chunkUsed;   // frame the chunk was last in or near the view
+    uint32_t *chunkAsked;  // frame its missing pages were last requested
+    uint32_t frame;
+    size_t residentBytes, requestedBytes, budget; // both count against the budget
+    int chunksVisible, impostors, requested, evicted; // since the last stats line
+    LodSprite *sprites; // numPlaneSets * LOD_DIRS^2, made on first use
+} Scene;
+
+typedef struct {
+    int fd;
+    char dir[256];
+    const char *name; // file name within dir
+} SceneWatch;
+
+// count records of size bytes at offset, or NULL if they run past the file
+static const void *sceneSection(const Scene *sc, uint64_t offset, uint32_t count, size_t size) {
+    if (offset % 8 || offset > sc->size || (uint64_t)count * size > sc->size - offset)
+        return NULL;
+    return (const uint8_t *)sc->map + offset;
+}
+
+static void sceneClose(Scene *sc) {
+    if (sc->map)
+        munmap(sc->map, sc->size);
+    if (sc->fd >= 0)
+        close(sc->fd);
+    free(sc->chunkState);
+    free(sc->chunkUsed);
+    free(sc->chunkAsked);
+    free(sc->sprites);
+    sc->map = NULL;
+    sc->fd = -1;
+    sc->chunkState = NULL;
+    sc->chunkUsed = NULL;
+    sc->chunkAsked = NULL;
+    sc->sprites = NULL;
+}
+
+static int sceneCheckInstances(const Scene *sc, uint32_t first, uint32_t count) {
+    for (uint32_t i = first; i < first + count; i++) {
+        const SceneInstance *in = &sc->instances[i];
+        if (in->planeSet >= sc->header->numPlaneSets || in->material >= sc->header->numMaterials || !(in->scale > 0))
+            return -1;
+    }
+    return 0;
+}
+
+// Points the sections into sc->map and checks them. NULL if the scene can
+// be used, else what is wrong with it.
+static const char *sceneAttach(Scene *sc) {
+    const SceneHeader *h = sc->header = sc->map;
+    const char *err = NULL;
+    if (h->magic != SCENE_MAGIC || h->version < 1 || h->version > SCENE_VERSION) {
+        err = "not a scene of version 1 or 2";
+    } else if (!(sc->planeSets = sceneSection(sc, h->planeSetOffset, h->numPlaneSets, sizeof(ScenePlaneSet))) ||
+               !(sc->planes = sceneSection(sc, h->planeOffset, h->numPlanes, sizeof(Plane))) ||
+               !(sc->materials = sceneSection(sc, h->materialOffset, h->numMaterials, sizeof(SceneMaterial))) ||
+               !(sc->lights = sceneSection(sc, h->lightOffset, h->numLights, sizeof(SceneLight))) ||
+               !(sc->instances = sceneSection(sc, h->instanceOffset, h->numInstances, sizeof(SceneInstance)))) {
+        err = "section out of bounds";
+    } else if (h->numLights > SCENE_MAX_LIGHTS) {
+        err = "too many lights";
+    } else if (h->version >= 2 && h->numChunks &&
+               !(sc->chunks = sceneSection(sc, h->chunkOffset, h->numChunks, sizeof(SceneChunk)))) {
+        err = "chunk table out of bounds";
+    }
+    for (uint32_t i = 0; !err && i < h->numPlaneSets; i++) {
+        const ScenePlaneSet *ps = &sc->planeSets[i];
+        if (ps->numPlanes == 0 || ps->numPlanes > MAX_PLANES ||
+            (uint64_t)ps->firstPlane + ps->numPlanes > h->numPlanes || !(ps->radius > 0))
+            err = "bad plane set";
+    }
+    // chunked scenes have their instances checked as each chunk comes in
+    sc->numChunks = sc->chunks ? h->numChunks : 0;
+    for (int c = 0; !err && c < sc->numChunks; c++) {
+        const SceneChunk *ch = &sc->chunks[c];
+        if (ch->firstInstance > h->numInstances || ch->numInstances > h->numInstances - ch->firstInstance ||
+            !(ch->radius > 0))
+            err = "bad chunk";
+    }
+    if (!err && !sc->numChunks && sceneCheckInstances(sc, 0, h->numInstances) < 0)
+        err = "bad instance";
+    if (!err && sc->numChunks) {
+        sc->chunkState = calloc(sc->numChunks, 1);
+        sc->chunkUsed = calloc(sc->numChunks, sizeof(uint32_t));
+        sc->chunkAsked = calloc(sc->numChunks, sizeof(uint32_t));
+        if (!sc->chunkState || !sc->chunkUsed || !sc->chunkAsked)
+            err = "out of memory";
+    }
+    return err;
+}
+
+// budget is the page cache allowance for chunked scenes, in bytes
+static int sceneOpen(Scene *sc, const char *path, size_t budget) {
+    memset(sc, 0, sizeof(*sc));
+    sc->fd = -1;
+    sc->budget = budget;
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(SceneHeader)) {
+        fprintf(stderr, "Failed to open scene %s\n", path);
+        if (fd >= 0)
+            close(fd);
+        return -1;
+    }
+    sc->size = st.st_size;
+    sc->map = mmap(NULL, sc->size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (sc->map == MAP_FAILED) {
+        sc->map = NULL;
+        close(fd);
+        fprintf(stderr, "Failed to map scene %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+    // no read-around on faults until we know the file isn't chunked, or
+    // touching the header would pull in megabytes of instances with it
+    madvise(sc->map, sc->size, MADV_RANDOM);
+    const SceneHeader *h = sc->map;
+    if (h->version < 2 || !h->numChunks)
+        madvise(sc->map, sc->size, MADV_NORMAL);
+    const char *err = sceneAttach(sc);
+    if (err) {
+        fprintf(stderr, "Bad scene %s: %s\n", path, err);
+        close(fd);
+        sceneClose(sc);
+        return -1;
+    }
+    if (sc->numChunks)
+        sc->fd = fd;
+    else
+        close(fd);
+    return 0;
+}
+
+// Watches the directory, not the file, so replacing it by rename is seen
+static int sceneWatchOpen(SceneWatch *w, const char *path) {
+    const char *slash = strrchr(path, '/');
+    w->name = slash ? slash + 1 : path;
+    if (!slash)
+        strcpy(w->dir, ".");
+    else
+        snprintf(w->dir, sizeof(w->dir), "%.*s", slash == path ? 1 : (int)(slash - path), path);
+    w->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (w->fd < 0 || inotify_add_watch(w->fd, w->dir, IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+        fprintf(stderr, "Failed to watch %s: %s\n", w->dir, strerror(errno));
+        if (w->fd >= 0)
+            close(w->fd);
+        return -1;
+    }
+    return 0;
+}
+
+// 1 if the scene file was written or renamed into place since the last call
+static int sceneWatchPoll(SceneWatch *w) {
+    char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    int changed = 0;
+    ssize_t len;
+    while ((len = read(w->fd, buf, sizeof(buf))) > 0) {
+        for (char *p = buf; p < buf + len; ) {
+            const struct inotify_event *ev = (const struct inotify_event *)p;
+            if (ev->len && !strcmp(ev->name, w->name))
+                changed = 1;
+            p += sizeof(*ev) + ev->len;
+        }
+    }
+    return changed;
+}
+
+static uint32_t sceneShade(const Scene *sc, const SceneMaterial *m, Vec3 n, Vec3 lightDir) {
+    double light = m->ambient;
+    if (sc->header->numLights == 0)
+        light += fmax(0, dot(n, lightDir));
+    for (uint32_t l = 0; l < sc->header->numLights; l++)
+        light += sc->lights[l].intensity * fmax(0, dot(n, sc->lights[l].dir));
+    uint32_t c = 0;
+    for (int shift = 16; shift >= 0; shift -= 8) {
+        double v = ((m->color >> shift) & 0xFF) * light;
+        c |= (uint32_t)(v > 255 ? 255 : v) << shift;
+    }
+    return c;
+}
+
+// Pixel bounds [x0, x1) x [y0, y1) of a sphere under the pinhole of
+// pixelRay (focal length 5 * scaleFactor px). Conservative: the extremes of
+// x/z over the sphere's bounding box are at its corners. 0 if off screen.
+static int sphereBounds(const RenderContext *ctx, Vec3 center, double radius, int *x0, int *y0, int *x1, int *y1) {
+    Vec3 rel = subtract(center, ctx->camPos);
+    double z = dot(rel, ctx->camForward), x = dot(rel, ctx->camRight), y = dot(rel, ctx->camUp);
+    double f = 5 * ctx->scaleFactor;
+    if (z + radius <= 0)
+        return 0;
+    // the four side planes of the frustum, so spheres level with the camera
+    // are only kept when they are actually beside the view and not behind it
+    double left = ctx->halfWidth, right = ctx->frame->width - ctx->halfWidth;
+    double top = ctx->halfHeight, bottom = ctx->frame->height - ctx->halfHeight;
+    if (f * x + left * z < -radius * sqrt(f * f + left * left) ||
+        right * z - f * x < -radius * sqrt(f * f + right * right) ||
+        top * z - f * y < -radius * sqrt(f * f + top * top) ||
+        f * y + bottom * z < -radius * sqrt(f * f + bottom * bottom))
+        return 0;
+    double lx = -1e9, hx = 1e9, ly = -1e9, hy = 1e9;
+    if (z - radius > 1e-6) {
+        lx = ctx->halfWidth + f * (x - radius) / (x - radius < 0 ? z - radius : z + radius);
+        hx = ctx->halfWidth + f * (x + radius) / (x + radius > 0 ? z - radius : z + radius);
+        ly = ctx->halfHeight - f * (y + radius) / (y + radius > 0 ? z - radius : z + radius);
+        hy = ctx->halfHeight - f * (y - radius) / (y - radius < 0 ? z - radius : z + radius);
+    }
+    if (hx < 0 || hy < 0 || lx >= ctx->frame->width || ly >= ctx->frame->height)
+        return 0;
+    *x0 = lx < 0 ? 0 : (int)lx;
+    *y0 = ly < 0 ? 0 : (int)ly;
+    *x1 = hx >= ctx->frame->width ? ctx->frame->width : (int)hx + 1;
+    *y1 = hy >= ctx->frame->height ? ctx->frame->height : (int)hy + 1;
+    return 1;
+}
+
+// Tile range of an item from its screen bounds, 0 if off screen
+static int sceneItemTiles(const RenderContext *ctx, SceneItem *item) {
+    if (!sphereBounds(ctx, item->center, item->radius, &item->x0, &item->y0, &item->x1, &item->y1)) {
+        item->tx0 = item->tx1 = 0;
+        return 0;
+    }
+    item->tx0 = item->x0 / TILE_SIZE;
+    item->ty0 = item->y0 / TILE_SIZE;
+    item->tx1 = (item->x1 - 1) / TILE_SIZE + 1;
+    item->ty1 = (item->y1 - 1) / TILE_SIZE + 1;
+    return 1;
+}
+
+// Octahedral cell of unit direction u on the LOD_DIRS x LOD_DIRS grid
+static int lodDirCell(Vec3 u) {
+    double s = fabs(u.x) + fabs(u.y) + fabs(u.z);
+    double x = u.x / s, y = u.y / s;
+    if (u.z < 0) {
+        double ox = x;
+        x = (1 - fabs(y)) * (x >= 0 ? 1 : -1);
+        y = (1 - fabs(ox)) * (y >= 0 ? 1 : -1);
+    }
+    int cx = (int)((x + 1) * 0.5 * LOD_DIRS), cy = (int)((y + 1) * 0.5 * LOD_DIRS);
+    return (cy < LOD_DIRS ? cy : LOD_DIRS - 1) * LOD_DIRS + (cx < LOD_DIRS ? cx : LOD_DIRS - 1);
+}
+
+// The direction at the middle of a cell, and the axes of its sprite
+// (right and up on screen when looking along dir, as in setCamera)
+static void lodDirBasis(int cell, Vec3 *dir, Vec3 *right, Vec3 *up) {
+    double x = (cell % LOD_DIRS + 0.5) * 2.0 / LOD_DIRS - 1, y = (cell / LOD_DIRS + 0.5) * 2.0 / LOD_DIRS - 1;
+    double z = 1 - fabs(x) - fabs(y);
+    if (z < 0) {
+        double ox = x;
+        x = (1 - fabs(y)) * (x >= 0 ? 1 : -1);
+        y = (1 - fabs(ox)) * (y >= 0 ? 1 : -1);
+    }
+    *dir = normalize((Vec3){ x, y, z });
+    *right = normalize(cross(fabs(dir->y) < 0.9 ? (Vec3){ 0, 1, 0 } : (Vec3){ 1, 0, 0 }, *dir));
+    *up = cross(*dir, *right);
+}
+
+// Sprite index / LOD_DIRS^2 is the plane set and index % LOD_DIRS^2 the
+// view cell. Orthographic, one ray along the cell direction per texel.
+static void lodSpriteJob(void *arg, int index) {
+    const Scene *sc = arg;
+    const ScenePlaneSet *ps = &sc->planeSets[index / (LOD_DIRS * LOD_DIRS)];
+    LodSprite *s = &sc->sprites[index];
+    Vec3 dir, right, up;
+    lodDirBasis(index % (LOD_DIRS * LOD_DIRS), &dir, &right, &up);
+    double r = ps->radius, texel = 2 * r / LOD_TEXELS;
+    int covered = 0;
+    memset(s->area, 0, sizeof(s->area));
+    for (int ty = 0; ty < LOD_TEXELS; ty++) {
+        for (int tx = 0; tx < LOD_TEXELS; tx++) {
+            int i = ty * LOD_TEXELS + tx;
+            Vec3 p = add(scale(right, (tx + 0.5) * texel - r), scale(up, r - (ty + 0.5) * texel));
+            double tNear, tFar;
+            const Plane *planes = &sc->planes[ps->firstPlane];
+            uint8_t f = traceRay(planes, ps->numPlanes, subtract(p, scale(dir, 2 * r)), dir, &tNear, &tFar);
+            // traceRay skips planes parallel to the ray, and the cells on the
+            // octahedron's equator are exactly parallel to axis-aligned faces
+            for (uint32_t q = 0; q < ps->numPlanes && f < ps->numPlanes; q++) {
+                if (fabs(dot(planes[q].n, dir)) < TOL && dot(planes[q].n, p) > planes[q].d)
+                    f = FACE_MISS;
+            }
+            s->face[i] = f < ps->numPlanes ? f : FACE_MISS;
+            s->depth[i] = 0;
+            if (f >= ps->numPlanes)
+                continue;
+            s->depth[i] = (int8_t)lrint(fmax(-1, fmin(1, tNear / r - 2)) * 127);
+            s->area[f]++;
+            covered++;
+        }
+    }
+    s->mainFace = 0;
+    for (uint32_t p = 1; p < ps->numPlanes; p++) {
+        if (s->area[p] > s->area[s->mainFace])
+            s->mainFace = p;
+    }
+    s->discRadius = sqrt(covered / M_PI) * 2 / LOD_TEXELS;
+}
+
+// Picks an instance's LOD from its projected diameter. Called with the
+// item's center, radius and rotation; sprites and discs get their sprite
+// oriented by the view direction in the instance's own frame.
+static void lodSelect(const RenderContext *ctx, const SceneView *view, const Scene *sc, const SceneInstance *in,
+                      double a, SceneItem *item) {
+    Vec3 rel = subtract(item->center, ctx->camPos);
+    double z = dot(rel, ctx->camForward);
+    item->lod = LOD_FULL;
+    if (z <= item->radius || 10 * ctx->scaleFactor * item->radius >= view->lodSprite * z)
+        return;
+    int cell = lodDirCell(unrotate(normalize(rel), a));
+    Vec3 dir, right, up;
+    lodDirBasis(cell, &dir, &right, &up);
+    double k = LOD_TEXELS / (2 * item->radius);
+    item->sprite = &sc->sprites[in->planeSet * LOD_DIRS * LOD_DIRS + cell];
+    item->spriteX = scale(rotate(right, a), k);
+    item->spriteY = scale(rotate(up, a), -k);
+    item->lod = LOD_SPRITE;
+    if (10 * ctx->scaleFactor * item->radius < view->lodDisc * z) {
+        item->lod = LOD_DISC;
+        item->radius *= item->sprite->discRadius;
+        item->face = item->sprite->mainFace;
+    }
+}
+
+typedef struct {
+    const Scene *scene;
+    SceneView *view;
+    const RenderContext *ctx;
+    Vec3 lightDir; // for scenes without lights
+    int count;
+} SceneBuildJobs;
+
+static void sceneBuildJob(void *arg, int index) {
+    SceneBuildJobs *jobs = arg;
+    const Scene *sc = jobs->scene;
+    const RenderContext *ctx = jobs->ctx;
+    int end = (index + 1) * SCENE_JOB_SIZE;
+    if (end > jobs->count)
+        end = jobs->count;
+    for (int k = index * SCENE_JOB_SIZE; k < end; k++) {
+        int i = jobs->view->pending[k];
+        const SceneInstance *in = &sc->instances[i];
+        const ScenePlaneSet *ps = &sc->planeSets[in->planeSet];
+        const SceneMaterial *m = &sc->materials[in->material];
+        SceneItem *item = &jobs->view->items[k];
+        double a = in->spin * ctx->angle + in->phase;
+        item->center = in->position;
+        item->radius = ps->radius * in->scale;
+        item->numPlanes = ps->numPlanes;
+        item->instance = i;
+        lodSelect(ctx, jobs->view, sc, in, a, item);
+        item->depth = dot(subtract(in->position, ctx->camPos), ctx->camForward) - item->radius;
+        if (!sceneItemTiles(ctx, item))
+            continue;
+        // n.x = d in instance space is (Rn).x = s d + (Rn).p in the world
+        item->inner = 1e30;
+        for (uint32_t p = 0; p < ps->numPlanes; p++) {
+            Plane *wp = &jobs->view->planes[item->firstPlane + p];
+            item->inner = fmin(item->inner, sc->planes[ps->firstPlane + p].d * in->scale);
+            wp->n = rotate(sc->planes[ps->firstPlane + p].n, a);
+            wp->d = sc->planes[ps->firstPlane + p].d * in->scale + dot(wp->n, in->position);
+            jobs->view->colors[item->firstPlane + p] = sceneShade(sc, m, wp->n, jobs->lightDir);
+        }
+        if (item->lod != LOD_DISC)
+            continue;
+        // the faces' colors weighted by how much of the sprite they cover
+        double rgb[3] = { 0, 0, 0 }, total = 0;
+        for (uint32_t p = 0; p < ps->numPlanes; p++) {
+            uint32_t c = jobs->view->colors[item->firstPlane + p];
+            for (int ch = 0; ch < 3; ch++)
+                rgb[ch] += item->sprite->area[p] * ((c >> (16 - 8 * ch)) & 0xFF);
+            total += item->sprite->area[p];
+        }
+        item->color = 0;
+        for (int ch = 0; ch < 3 && total > 0; ch++)
+            item->color |= (uint32_t)lrint(rgb[ch] / total) << (16 - 8 * ch);
+    }
+}
+
+static int chunkInView(const RenderContext *ctx, const SceneChunk *ch) {
+    int x0, y0, x1, y1;
+    double depth = dot(subtract(ch->center, ctx->camPos), ctx->camForward);
+    return depth - ch->radius < SCENE_FAR && sphereBounds(ctx, ch->center, ch->radius, &x0, &y0, &x1, &y1);
+}
+
+// Page-aligned span of the chunk's instances in the mapping
+static uint8_t *chunkPages(const Scene *sc, const SceneChunk *ch, size_t *len) {
+    uintptr_t page = sysconf(_SC_PAGESIZE);
+    uintptr_t start = (uintptr_t)(sc->instances + ch->firstInstance) & ~(page - 1);
+    uintptr_t end = ((uintptr_t)(sc->instances + ch->firstInstance + ch->numInstances) + page - 1) & ~(page - 1);
+    *len = end - start;
+    return (uint8_t *)start;
+}
+
+// mincore: would reading the chunk fault to disk? With fetch, the pages
+// that would are also requested, at most SCENE_READAHEAD per WILLNEED so
+// chunks bigger than the kernel's read-ahead window come in whole, and
+// pages reclaimed since an earlier request are asked for again.
+static int chunkResident(const Scene *sc, const SceneChunk *ch, int fetch) {
+    size_t len, page = sysconf(_SC_PAGESIZE);
+    uint8_t *start = chunkPages(sc, ch, &len);
+    unsigned char vec[64];
+    size_t run = 0, runPages = 0; // missing pages not yet requested
+    int missing = 0;
+    for (size_t off = 0; off < len; off += sizeof(vec) * page) {
+        size_t n = (len - off) / page < sizeof(vec) ? (len - off) / page : sizeof(vec);
+        if (mincore(start + off, n * page, vec) < 0)
+            return 0;
+        for (size_t p = 0; p < n; p++) {
+            if (vec[p] & 1)
+                continue;
+            if (!fetch)
+                return 0;
+            missing = 1;
+            size_t at = off + p * page;
+            if (runPages && (run + runPages * page != at || runPages * page >= SCENE_READAHEAD)) {
+                madvise(start + run, runPages * page, MADV_WILLNEED);
+                runPages = 0;
+            }
+            if (!runPages)
+                run = at;
+            runPages++;
+        }
+    }
+    if (runPages)
+        madvise(start + run, runPages * page, MADV_WILLNEED);
+    return !missing;
+}
+
+// Back to cold, whether the chunk made it in or is still on its way
+static void chunkEvict(Scene *sc, int c) {
+    size_t len;
+    uint8_t *start = chunkPages(sc, &sc->chunks[c], &len);
+    // unmapped pages first, the page cache keeps any that are still mapped
+    madvise(start, len, MADV_DONTNEED);
+    posix_fadvise(sc->fd, start - (uint8_t *)sc->map, len, POSIX_FADV_DONTNEED);
+    if (sc->chunkState[c] == CHUNK_RESIDENT)
+        sc->residentBytes -= len;
+    else
+        sc->requestedBytes -= len;
+    sc->chunkState[c] = CHUNK_COLD;
+    sc->evicted++;
+}
+
+// Picks this frame's work per chunk: instances for chunks in view and paged
+// in, an impostor for those in view but still loading, and read-ahead for
+// the ones in view now or in the predicted view of ahead. Fills
+// view->pending and view->impostors and returns the pending count.
+static int sceneStream(Scene *sc, SceneView *view, const RenderContext *ctx, const RenderContext *ahead) {
+    int count = 0;
+    sc->frame++;
+    view->numImpostors = 0;
+    for (int c = 0; c < sc->numChunks; c++) {
+        const SceneChunk *ch = &sc->chunks[c];
+        int visible = chunkInView(ctx, ch);
+        if (!visible && !(ahead && chunkInView(ahead, ch)))
+            continue;
+        sc->chunkUsed[c] = sc->frame;
+        int state = sc->chunkState[c];
+        if (state == CHUNK_COLD || state == CHUNK_REQUESTED) {
+            // read-ahead can be reclaimed before we get to it, and nothing
+            // else touches an impostor's pages, so requests are repeated
+            int fetch = state == CHUNK_COLD || sc->frame - sc->chunkAsked[c] >= SCENE_RETRY_FRAMES;
+            size_t len;
+            chunkPages(sc, ch, &len);
+            if (chunkResident(sc, ch, fetch)) {
+                if (state == CHUNK_REQUESTED)
+                    sc->requestedBytes -= len;
+                if (sceneCheckInstances(sc, ch->firstInstance, ch->numInstances) < 0) {
+                    fprintf(stderr, "Scene chunk %d has bad instances, skipping it\n", c);
+                    sc->chunkState[c] = CHUNK_BAD;
+                } else {
+                    sc->chunkState[c] = CHUNK_RESIDENT;
+                    sc->residentBytes += len;
+                }
+            } else if (fetch) {
+                if (state == CHUNK_COLD)
+                    sc->requestedBytes += len;
+                sc->chunkState[c] = CHUNK_REQUESTED;
+                sc->chunkAsked[c] = sc->frame;
+                sc->requested++;
+            }
+        }
+        if (!visible)
+            continue;
+        sc->chunksVisible++;
+        if (sc->chunkState[c] == CHUNK_RESIDENT) {
+            if (count + (int)ch->numInstances > view->pendingCapacity) {
+                int capacity = (count + ch->numInstances) * 2;
+                int *pending = realloc(view->pending, sizeof(int) * capacity);
+                if (!pending)
+                    return -1;
+                view->pending = pending;
+                view->pendingCapacity = capacity;
+            }
+            for (uint32_t i = 0; i < ch->numInstances; i++)
+                view->pending[count++] = ch->firstInstance + i;
+        } else if (sc->chunkState[c] == CHUNK_REQUESTED) {
+            if (view->numImpostors == view->impostorCapacity) {
+                int capacity = view->impostorCapacity ? view->impostorCapacity * 2 : 64;
+                int *impostors = realloc(view->impostors, sizeof(int) * capacity);
+                if (!impostors)
+                    return -1;
+                view->impostors = impostors;
+                view->impostorCapacity = capacity;
+            }
+            view->impostors[view->numImpostors++] = c;
+            sc->impostors++;
+        }
+    }
+    // over budget: drop the chunks that have been out of sight the longest,
+    // including read-ahead for ones the camera turned away from
+    while (sc->residentBytes + sc->requestedBytes > sc->budget) {
+        int oldest = -1;
+        for (int c = 0; c < sc->numChunks; c++) {
+            if ((sc->chunkState[c] == CHUNK_RESIDENT || sc->chunkState[c] == CHUNK_REQUESTED) &&
+                sc->chunkUsed[c] != sc->frame &&
+                (oldest < 0 || sc->chunkUsed[c] < sc->chunkUsed[oldest]))
+                oldest = c;
+        }
+        if (oldest < 0)
+            break;
+        chunkEvict(sc, oldest);
+    }
+    return count;
+}
+
+static int compareItemDepth(const void *a, const void *b) {
+    double da = ((const SceneItem *)a)->depth, db = ((const SceneItem *)b)->depth;
+    return (da > db) - (da < db);
+}
+
+/*
+ * Hierarchical-Z occlusion (--hiz). The nearest instances are drawn into a
+ * depth buffer of HIZ_BLOCK pixel blocks as a conservative silhouette: the
+ * disc of their inscribed sphere facing the camera, which projects to a
+ * circle and lies at the depth of the center. A block only takes a depth if
+ * every pixel in it is inside such a disc. A max pyramid over the blocks
+ * then rejects each instance whose bounding sphere starts behind all of the
+ * at most 3x3 texels its screen bounds touch on the level where they are
+ * one or two texels across. Depths are along the view axis, like
+ * SceneItem.depth, and occluders never reject themselves since their disc
+ * is behind their nearest point.
+ */
+static int sceneOcclude(SceneView *view, const RenderContext *ctx) {
+    int lw[32], lh[32], offset[32], levels = 0, total = 0;
+    int w = (ctx->frame->width + HIZ_BLOCK - 1) / HIZ_BLOCK, h = (ctx->frame->height + HIZ_BLOCK - 1) / HIZ_BLOCK;
+    for (;;) {
+        lw[levels] = w;
+        lh[levels] = h;
+        offset[levels++] = total;
+        total += w * h;
+        if (w == 1 && h == 1)
+            break;
+        w = (w + 1) / 2;
+        h = (h + 1) / 2;
+    }
+    if (total > view->hizCapacity) {
+        float *hiz = realloc(view->hiz, sizeof(float) * total);
+        if (!hiz)
+            return -1;
+        view->hiz = hiz;
+        view->hizCapacity = total;
+    }
+    Uint64 start = SDL_GetPerformanceCounter();
+    float *base = view->hiz;
+    for (int i = 0; i < lw[0] * lh[0]; i++)
+        base[i] = INFINITY;
+    double f = 5 * ctx->scaleFactor;
+    int occluders = 0;
+    for (int i = 0; i < view->numItems && occluders < HIZ_OCCLUDERS; i++) {
+        const SceneItem *item = &view->items[i];
+        Vec3 rel = subtract(item->center, ctx->camPos);
+        double z = dot(rel, ctx->camForward);
+        double r = z > 1e-6 ? f * item->inner / z : 0;
+        if (r < HIZ_MIN_RADIUS)
+            continue;
+        double cx = ctx->halfWidth + f * dot(rel, ctx->camRight) / z;
+        double cy = ctx->halfHeight - f * dot(rel, ctx->camUp) / z;
+        int bx0 = (int)fmax(0, floor((cx - r) / HIZ_BLOCK)), bx1 = (int)fmin(lw[0], ceil((cx + r) / HIZ_BLOCK));
+        int by0 = (int)fmax(0, floor((cy - r) / HIZ_BLOCK)), by1 = (int)fmin(lh[0], ceil((cy + r) / HIZ_BLOCK));
+        occluders++;
+        for (int by = by0; by < by1; by++) {
+            // pixels sample at their integer coordinates, see pixelRay
+            double dy = fmax(fabs(by * HIZ_BLOCK - cy), fabs(by * HIZ_BLOCK + HIZ_BLOCK - 1 - cy));
+            for (int bx = bx0; bx < bx1; bx++) {
+                double dx = fmax(fabs(bx * HIZ_BLOCK - cx), fabs(bx * HIZ_BLOCK + HIZ_BLOCK - 1 - cx));
+                if (dx * dx + dy * dy <= r * r && z < base[by * lw[0] + bx])
+                    base[by * lw[0] + bx] = (float)z;
+            }
+        }
+    }
+    for (int l = 1; l < levels; l++) {
+        const float *fine = view->hiz + offset[l - 1];
+        float *coarse = view->hiz + offset[l];
+        for (int y = 0; y < lh[l]; y++) {
+            for (int x = 0; x < lw[l]; x++) {
+                float m = 0;
+                for (int sy = 2 * y; sy < 2 * y + 2 && sy < lh[l - 1]; sy++)
+                    for (int sx = 2 * x; sx < 2 * x + 2 && sx < lw[l - 1]; sx++)
+                        m = fmaxf(m, fine[sy * lw[l - 1] + sx]);
+                coarse[y * lw[l] + x] = m;
+            }
+        }
+    }
+    int kept = 0;
+    for (int i = 0; i < view->numItems; i++) {
+        const SceneItem *item = &view->items[i];
+        int bx0 = item->x0 / HIZ_BLOCK, bx1 = (item->x1 - 1) / HIZ_BLOCK;
+        int by0 = item->y0 / HIZ_BLOCK, by1 = (item->y1 - 1) / HIZ_BLOCK;
+        int l = 0;
+        while (l < levels - 1 && ((bx1 >> l) - (bx0 >> l) > 1 || (by1 >> l) - (by0 >> l) > 1))
+            l++;
+        float far = 0;
+        for (int y = by0 >> l; y <= by1 >> l; y++)
+            for (int x = bx0 >> l; x <= bx1 >> l; x++)
+                far = fmaxf(far, view->hiz[offset[l] + y * lw[l] + x]);
+        if (item->depth > far)
+            continue;
+        view->items[kept++] = *item;
+    }
+    view->hizTested += view->numItems;
+    view->hizCulled += view->numItems - kept;
+    view->hizOccluders += occluders;
+    view->hizTicks += SDL_GetPerformanceCounter() - start;
+    view->numItems = kept;
+    return 0;
+}
+
+// Keeps the instances that made it on screen (and past --hiz), nearest
+// first, and lists each one in every tile its bounds touch (counting pass,
+// then fill)
+static int sceneBin(SceneView *view, const RenderContext *ctx, int count) {
+    int visible = 0;
+    for (int i = 0; i < count; i++) {
+        if (view->items[i].tx1 > view->items[i].tx0)
+            view->items[visible++] = view->items[i];
+    }
+    qsort(view->items, visible, sizeof(SceneItem), compareItemDepth);
+    view->numItems = visible;
+    if (view->occlusion && sceneOcclude(view, ctx) < 0)
+        return -1;
+    visible = view->numItems;
+    for (int i = 0; i < visible; i++) {
+        if (view->items[i].instance >= 0)
+            view->lodCount[view->items[i].lod]++;
+    }
+
+    int tilesX = (ctx->frame->width + TILE_SIZE - 1) / TILE_SIZE;
+    int numTiles = tilesX * ((ctx->frame->height + TILE_SIZE - 1) / TILE_SIZE);
+    if (numTiles + 1 > view->tileCapacity) {
+        int *start = realloc(view->binStart, sizeof(int) * (numTiles + 1));
+        int *fill = start ? realloc(view->binFill, sizeof(int) * numTiles) : NULL;
+        if (start)
+            view->binStart = start;
+        if (!fill)
+            return -1;
+        view->binFill = fill;
+        view->tileCapacity = numTiles + 1;
+    }
+    memset(view->binStart, 0, sizeof(int) * (numTiles + 1));
+    for (int i = 0; i < visible; i++) {
+        const SceneItem *item = &view->items[i];
+        for (int ty = item->ty0; ty < item->ty1; ty++)
+            for (int tx = item->tx0; tx < item->tx1; tx++)
+                view->binStart[ty * tilesX + tx + 1]++;
+    }
+    for (int t = 0; t < numTiles; t++)
+        view->binStart[t + 1] += view->binStart[t];
+    view->binned = view->binStart[numTiles];
+    if (view->binned > view->binCapacity) {
+        int *items = realloc(view->binItems, sizeof(int) * view->binned);
+        if (!items)
+            return -1;
+        view->binItems = items;
+        view->binCapacity = view->binned;
+    }
+    memcpy(view->binFill, view->binStart, sizeof(int) * numTiles);
+    for (int i = 0; i < visible; i++) {
+        const SceneItem *item = &view->items[i];
+        for (int ty = item->ty0; ty < item->ty1; ty++)
+            for (int tx = item->tx0; tx < item->tx1; tx++)
+                view->binItems[view->binFill[ty * tilesX + tx]++] = i;
+    }
+    return 0;
+}
+
+// Per-frame setup: streaming for chunked scenes, LOD sprites the first time
+// they are needed, world planes and colors for the instances to draw on the
+// pool, impostors, then the binning.
+// ahead is the camera expected SCENE_PREFETCH_MS from now, or NULL.
+// Returns -1 when out of memory.
+static int sceneBuild(WorkerPool *pool, SceneView *view, Scene *sc, const RenderContext *ctx,
+                      const RenderContext *ahead, Vec3 lightDir) {
+    int count = sc->header->numInstances;
+    if (sc->numChunks) {
+        count = sceneStream(sc, view, ctx, ahead);
+        if (count < 0)
+            return -1;
+    } else {
+        if (count > view->pendingCapacity) {
+            int *pending = realloc(view->pending, sizeof(int) * count);
+            if (!pending)
+                return -1;
+            view->pending = pending;
+            view->pendingCapacity = count;
+        }
+        for (int i = 0; i < count; i++)
+            view->pending[i] = i;
+        view->numImpostors = 0;
+    }
+    if (view->lodSprite > 0 && !sc->sprites) {
+        int sprites = sc->header->numPlaneSets * LOD_DIRS * LOD_DIRS;
+        if (!(sc->sprites = malloc(sizeof(LodSprite) * sprites)))
+            return -1;
+        poolRun(pool, lodSpriteJob, sc, sprites);
+    }
+    int numItems = count + view->numImpostors;
+    if (numItems > view->itemCapacity) {
+        SceneItem *items = realloc(view->items, sizeof(SceneItem) * numItems);
+        if (!items)
+            return -1;
+        view->items = items;
+        view->itemCapacity = numItems;
+    }
+    int planes = 0;
+    for (int k = 0; k < count; k++) {
+        view->items[k].firstPlane = planes;
+        planes += sc->planeSets[sc->instances[view->pending[k]].planeSet].numPlanes;
+    }
+    if (planes > view->planeCapacity) {
+        int capacity = planes;
+        Plane *p = realloc(view->planes, sizeof(Plane) * capacity);
+        uint32_t *c = p ? realloc(view->colors, sizeof(uint32_t) * capacity) : NULL;
+        if (p)
+            view->planes = p;
+        if (!c)
+            return -1;
+        view->colors = c;
+        view->planeCapacity = capacity;
+    }
+    SceneBuildJobs jobs = { sc, view, ctx, lightDir, count };
+    poolRun(pool, sceneBuildJob, &jobs, (count + SCENE_JOB_SIZE - 1) / SCENE_JOB_SIZE);
+    for (int j = 0; j < view->numImpostors; j++) {
+        const SceneChunk *ch = &sc->chunks[view->impostors[j]];
+        SceneItem *item = &view->items[count + j];
+        item->center = ch->center;
+        item->radius = ch->radius;
+        item->depth = dot(subtract(ch->center, ctx->camPos), ctx->camForward) - ch->radius;
+        item->numPlanes = 0;
+        item->instance = -1;
+        item->inner = 0;
+        item->lod = LOD_DISC;
+        item->color = lerpColor(ch->color, 0, 0.5);
+        item->face = 0;
+        sceneItemTiles(ctx, item);
+    }
+    return sceneBin(view, ctx, numItems);
+}
+
+static void sceneViewFree(SceneView *view) {
+    free(view->planes);
+    free(view->colors);
+    free(view->items);
+    free(view->binStart);
+    free(view->binFill);
+    free(view->binItems);
+    free(view->pending);
+    free(view->impostors);
+    free(view->hiz);
+}
+
+// Distance along dir to item if it is nearer than tBest, else -1. A disc
+// is hit on its sphere; a sprite is looked up where the ray passes closest
+// to the center, which is as good as a plane through it for a few pixels.
+static double sceneHitItem(const RenderContext *ctx, const SceneItem *item, Vec3 dir, double tBest,
+                           uint8_t *face, int *tests) {
+    Vec3 oc = subtract(ctx->camPos, item->center);
+    double half = dot(oc, dir), c = dot(oc, oc) - item->radius * item->radius;
+    if ((half > 0 && c > 0) || half * half < c)
+        return -1;
+    if (item->lod == LOD_DISC) {
+        double t = -half - sqrt(half * half - c);
+        if (t <= 0 || t >= tBest)
+            return -1;
+        *face = item->face;
+        return t;
+    }
+    if (item->lod == LOD_SPRITE) {
+        Vec3 offset = subtract(oc, scale(dir, half));
+        double u = dot(offset, item->spriteX) + LOD_TEXELS / 2, v = dot(offset, item->spriteY) + LOD_TEXELS / 2;
+        if (u < 0 || v < 0 || u >= LOD_TEXELS || v >= LOD_TEXELS)
+            return -1;
+        int texel = (int)v * LOD_TEXELS + (int)u;
+        double t = -half + item->sprite->depth[texel] * item->radius / 127;
+        if (item->sprite->face[texel] == FACE_MISS || t <= 0 || t >= tBest)
+            return -1;
+        *face = item->sprite->face[texel];
+        return t;
+    }
+    // nothing inside the sphere is nearer than where the ray enters it
+    if (-half - sqrt(half * half - c) >= tBest)
+        return -1;
+    double tNear;
+    uint8_t f = traceRayBefore(&ctx->scene->planes[item->firstPlane], item->numPlanes, ctx->camPos, dir, tBest,
+                               &tNear);
+    (*tests)++;
+    if (f >= item->numPlanes || tNear <= 0 || tNear >= tBest)
+        return -1;
+    *face = f;
+    return tNear;
+}
+
+// Nearest hit over all items, for picking. A ray can't meet an item closer
+// than its depth, so with the items sorted by depth the walk stops at the
+// first one beyond the current hit. Returns the item or -1.
+static int sceneTraceRay(const RenderContext *ctx, Vec3 dir, double *tHit, uint8_t *face) {
+    const SceneView *view = ctx->scene;
+    int hit = -1, tests = 0;
+    *tHit = 1e30;
+    for (int i = 0; i < view->numItems && view->items[i].depth < *tHit; i++) {
+        double t = sceneHitItem(ctx, &view->items[i], dir, *tHit, face, &tests);
+        if (t >= 0) {
+            *tHit = t;
+            hit = i;
+        }
+    }
+    return hit;
+}
+
+// A tile is filled item by item, nearest first, against a tile-local depth
+// buffer, so an item costs the pixels of its bounds rather than the whole
+// tile. Face IDs are the plane index within the instance; misses are copied
+// from the background a run at a time as in resolveRow.
+static int sceneTile(const RenderContext *ctx, int tile, int x0, int y0, int x1, int y1) {
+    SceneView *view = ctx->scene;
+    Frame *frame = ctx->frame;
+    const int *list = &view->binItems[view->binStart[tile]];
+    int count = view->binStart[tile + 1] - view->binStart[tile];
+    int w = x1 - x0, tests = 0;
+    Vec3 dirs[TILE_SIZE * TILE_SIZE];
+    double tHit[TILE_SIZE * TILE_SIZE];
+    int hitItem[TILE_SIZE * TILE_SIZE];
+    uint8_t hitFace[TILE_SIZE * TILE_SIZE];
+    for (int y = y0; y < y1; y++) {
+        for (int x = x0; x < x1; x++) {
+            int p = (y - y0) * w + (x - x0);
+            tHit[p] = 1e30;
+            hitItem[p] = -1;
+            if (count)
+                dirs[p] = pixelRay(ctx, x, y);
+        }
+    }
+    for (int b = 0; b < count; b++) {
+        const SceneItem *item = &view->items[list[b]];
+        int ix0 = item->x0 > x0 ? item->x0 : x0, ix1 = item->x1 < x1 ? item->x1 : x1;
+        int iy0 = item->y0 > y0 ? item->y0 : y0, iy1 = item->y1 < y1 ? item->y1 : y1;
+        for (int y = iy0; y < iy1; y++) {
+            for (int x = ix0; x < ix1; x++) {
+                int p = (y - y0) * w + (x - x0);
+                if (item->depth >= tHit[p])
+                    continue;
+                double t = sceneHitItem(ctx, item, dirs[p], tHit[p], &hitFace[p], &tests);
+                if (t >= 0) {
+                    tHit[p] = t;
+                    hitItem[p] = list[b];
+                }
+            }
+        }
+    }
+    for (int y = y0; y < y1; y++) {
+        uint8_t *ids = &frame->faceIds[y * frame->width];
+        uint32_t *out = &frame->pixels[y * frame->width];
+        const uint32_t *bg = &ctx->background[y * frame->width];
+        int missStart = x0;
+        for (int x = x0; x < x1; x++) {
+            int p = (y - y0) * w + (x - x0);
+            if (hitItem[p] < 0) {
+                ids[x] = FACE_MISS;
+                continue;
+            }
+            const SceneItem *item = &view->items[hitItem[p]];
+            ids[x] = hitFace[p];
+            memcpy(out + missStart, bg + missStart, sizeof(uint32_t) * (x - missStart));
+            out[x] = item->lod == LOD_DISC ? item->color : view->colors[item->firstPlane + hitFace[p]];
+            missStart = x + 1;
+        }
+        memcpy(out + missStart, bg + missStart, sizeof(uint32_t) * (x1 - missStart));
+    }
+    SDL_AtomicAdd(&view->tests, tests);
+    return (x1 - x0) * (y1 - y0);
+}
+
+// --fly: straight down +z at speed, swaying a little so chunks also enter
+// from the sides
+static void flyCamera(RenderContext *ctx, double t, double speed) {
+    double yaw = 0.3 * sin(t * 0.25);
+    Vec3 pos = { 4 * sin(t * 0.1), 0, -5 + speed * t };
+    setCamera(ctx, pos, add(pos, (Vec3){ sin(yaw), 0, cos(yaw) }), (Vec3){ 0, 1, 0 });
+}
+
+// Demo instance i at pos: random spin, phase, material and a third cubes
+static SceneInstance demoInstance(int i, Vec3 pos, double scale, int numMaterials) {
+    uint32_t s = hash32(i * 4 + 2), m = hash32(i * 4 + 3);
+    SceneInstance in;
+    memset(&in, 0, sizeof(in));
+    in.position = pos;
+    in.scale = scale;
+    in.spin = (0.5 + s / 4294967296.0) * ((s & 1) ? 1 : -1);
+    in.phase = 2 * M_PI * (m / 4294967296.0);
+    in.planeSet = (m >> 8) % 3 == 0;
+    in.material = (m >> 16) % numMaterials;
+    return in;
+}
+
+// Writes a demo scene of count instances, dodecahedra and cubes with a few
+// materials and two lights, through a temporary file renamed into place so
+// a running --scene picks it up whole. The default is a grid filling the
+// view; field is a chunked slab 32 x 16 instances across and as long as it
+// takes along +z, to fly through with --fly.
+static int writeScene(const char *path, int count, int field) {
+    Plane planes[2 * MAX_PLANES];
+    ScenePlaneSet sets[2];
+    int setVertices[2] = { NUM_VERTICES, 8 }; // the cube is the first 8 vertices
+    uint32_t numPlanes = 0;
+    for (int s = 0; s < 2; s++) {
+        double radius = 0;
+        for (int i = 0; i < setVertices[s]; i++)
+            radius = fmax(radius, length(baseVertices[i]));
+        int n = computeBasePlanes(baseVertices, setVertices[s], planes + numPlanes, MAX_PLANES);
+        sets[s] = (ScenePlaneSet){ numPlanes, (uint32_t)n, radius };
+        numPlanes += n;
+    }
+    const SceneMaterial materials[] = {
+        { 0xE8E8E8, 0.08f }, { 0xE0533D, 0.08f }, { 0x3D8BE0, 0.08f },
+        { 0xF2C14E, 0.08f }, { 0x5FB877, 0.08f }, { 0x9C6ADE, 0.08f },
+    };
+    SceneLight lights[2] = {
+        { normalize((Vec3){ 1, 1, -1 }), 0.9 },
+        { normalize((Vec3){ -1, 0.3, -0.5 }), 0.3 },
+    };
+    int numMaterials = sizeof(materials) / sizeof(materials[0]);
+    int perChunk = FIELD_CHUNK * FIELD_CHUNK * FIELD_CHUNK;
+    long page = sysconf(_SC_PAGESIZE);
+
+    SceneHeader h;
+    memset(&h, 0, sizeof(h));
+    h.magic = SCENE_MAGIC;
+    h.version = SCENE_VERSION;
+    h.numPlaneSets = 2;
+    h.numPlanes = numPlanes;
+    h.numMaterials = numMaterials;
+    h.numLights = 2;
+    h.numInstances = count;
+    h.numChunks = field ? (count + perChunk - 1) / perChunk : 0;
+    h.planeSetOffset = sizeof(h);
+    h.planeOffset = h.planeSetOffset + sizeof(sets);
+    h.materialOffset = h.planeOffset + sizeof(Plane) * numPlanes;
+    h.lightOffset = h.materialOffset + sizeof(materials);
+    h.instanceOffset = h.lightOffset + sizeof(lights);
+    if (field) // page-aligned so a chunk's pages hold nothing else
+        h.instanceOffset = (h.instanceOffset + page - 1) / page * page;
+    h.chunkOffset = h.instanceOffset + sizeof(SceneInstance) * (uint64_t)count;
+    SceneChunk *chunks = calloc(h.numChunks ? h.numChunks : 1, sizeof(SceneChunk));
+    SceneInstance *block = malloc(sizeof(SceneInstance) * perChunk);
+
+    char tmp[1024];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    FILE *f = fopen(tmp, "wb");
+    if (!f || !chunks || !block) {
+        fprintf(stderr, "Failed to create %s\n", tmp);
+        if (f)
+            fclose(f);
+        free(chunks);
+        free(block);
+        return 1;
+    }
+    fwrite(&h, sizeof(h), 1, f);
+    fwrite(sets, sizeof(sets), 1, f);
+    fwrite(planes, sizeof(Plane), numPlanes, f);
+    fwrite(materials, sizeof(materials), 1, f);
+    fwrite(lights, sizeof(lights), 1, f);
+    for (long pad = h.lightOffset + sizeof(lights); pad < (long)h.instanceOffset; pad++)
+        fputc(0, f);
+
+    if (!field) {
+        // a grid filling the default view at 4:3, jittered in depth
+        int cols = (int)ceil(sqrt(count * 4.0 / 3.0));
+        int rows = (count + cols - 1) / cols;
+        double spacing = 2.6 / cols;
+        for (int i = 0; i < count; i++) {
+            Vec3 pos = { (i % cols - (cols - 1) / 2.0) * spacing, ((rows - 1) / 2.0 - i / cols) * spacing,
+                         spacing * (hash32(i * 4 + 1) / 4294967296.0) };
+            SceneInstance in = demoInstance(i, pos, 0.22 * spacing, numMaterials);
+            fwrite(&in, sizeof(in), 1, f);
+        }
+    }
+    // the field goes out a chunk (a FIELD_CHUNK^3 block of the lattice) at a time
+    int chunksX = 32 / FIELD_CHUNK, chunksY = 16 / FIELD_CHUNK;
+    for (uint32_t c = 0; c < h.numChunks; c++) {
+        int cx = c % chunksX, cy = c / chunksX % chunksY, cz = c / (chunksX * chunksY);
+        int n = (count - (int)c * perChunk < perChunk) ? count - (int)c * perChunk : perChunk;
+        SceneChunk *ch = &chunks[c];
+        ch->firstInstance = c * perChunk;
+        ch->numInstances = n;
+        ch->center = (Vec3){ (cx + 0.5) * FIELD_CHUNK - 16, (cy + 0.5) * FIELD_CHUNK - 8, (cz + 0.5) * FIELD_CHUNK };
+        double rgb[3] = { 0, 0, 0 };
+        for (int k = 0; k < n; k++) {
+            int i = c * perChunk + k;
+            uint32_t j = hash32(i * 4 + 1);
+            Vec3 pos = { cx * FIELD_CHUNK + k % FIELD_CHUNK - 15.5 + ((j & 0xFF) / 255.0 - 0.5) * 0.5,
+                         cy * FIELD_CHUNK + k / FIELD_CHUNK % FIELD_CHUNK - 7.5 + ((j >> 8 & 0xFF) / 255.0 - 0.5) * 0.5,
+                         cz * FIELD_CHUNK + k / (FIELD_CHUNK * FIELD_CHUNK) + 0.5 + ((j >> 16 & 0xFF) / 255.0 - 0.5) * 0.5 };
+            block[k] = demoInstance(i, pos, 0.2, numMaterials);
+            ch->radius = fmax(ch->radius, length(subtract(pos, ch->center)) + 0.2 * sets[block[k].planeSet].radius);
+            for (int shift = 16, ch3 = 0; shift >= 0; shift -= 8, ch3++)
+                rgb[ch3] += (materials[block[k].material].color >> shift) & 0xFF;
+        }
+        ch->color = (uint32_t)(rgb[0] / n) << 16 | (uint32_t)(rgb[1] / n) << 8 | (uint32_t)(rgb[2] / n);
+        fwrite(block, sizeof(SceneInstance), n, f);
+    }
+    fwrite(chunks, sizeof(SceneChunk), h.numChunks, f);
+    free(chunks);
+    free(block);
+    if (fclose(f) != 0 || rename(tmp, path) < 0) {
+        fprintf(stderr, "Failed to write %s\n", path);
+        unlink(tmp);
+        return 1;
+    }
+    printf("Wrote %s: %d instances in %u chunks, %lu bytes\n", path, count, h.numChunks,
+           (unsigned long)(h.chunkOffset + sizeof(SceneChunk) * h.numChunks));
+    return 0;
+}
+
+// Runs sceneAttach over a one-cube scene and broken copies of it, which
+// must all be turned down rather than traced past the end of the mapping
+static int testScene(void) {
+    struct {
+        SceneHeader h;
+        ScenePlaneSet set;
+        Plane planes[6];
+        SceneMaterial material;
+        SceneInstance instance;
+    } good, bad;
+    memset(&good, 0, sizeof(good));
+    const uint8_t *base = (const uint8_t *)&good;
+    good.h.magic = SCENE_MAGIC;
+    good.h.version = SCENE_VERSION;
+    good.h.numPlaneSets = good.h.numMaterials = good.h.numInstances = 1;
+    good.h.numPlanes = 6;
+    good.h.planeSetOffset = (const uint8_t *)&good.set - base;
+    good.h.planeOffset = (const uint8_t *)good.planes - base;
+    good.h.materialOffset = (const uint8_t *)&good.material - base;
+    good.h.lightOffset = good.h.instanceOffset = (const uint8_t *)&good.instance - base;
+    good.set = (ScenePlaneSet){ 0, 6, sqrt(3) };
+    const Vec3 normals[6] = { { 1, 0, 0 }, { -1, 0, 0 }, { 0, 1, 0 }, { 0, -1, 0 }, { 0, 0, 1 }, { 0, 0, -1 } };
+    for (int p = 0; p < 6; p++)
+        good.planes[p] = (Plane){ normals[p], 1 };
+    good.material = (SceneMaterial){ 0xFFFFFF, 0 };
+    good.instance = (SceneInstance){ { 0, 0, 0 }, 1, 1, 0, 0, 0 };
+
+    const char *cases[] = {
+        "intact", "no planes for a set of 6", "set past the planes", "set wrapping around",
+        "planes past the end", "instance of a missing set", "bad magic",
+    };
+    int numCases = sizeof(cases) / sizeof(cases[0]), wrong = 0;
+    for (int c = 0; c < numCases; c++) {
+        bad = good;
+        switch (c) {
+        case 1: bad.h.numPlanes = 0; break;
+        case 2: bad.set.firstPlane = 1; break;
+        case 3: bad.set.firstPlane = UINT32_MAX - 2; break;
+        case 4: bad.h.numPlanes = 1000; break;
+        case 5: bad.instance.planeSet = 1; break;
+        case 6: bad.h.magic = 0; break;
+        }
+        Scene sc;
+        memset(&sc, 0, sizeof(sc));
+        sc.fd = -1;
+        sc.map = &bad;
+        sc.size = sizeof(bad);
+        const char *err = sceneAttach(&sc);
+        int right = c == 0 ? !err : err != NULL;
+        printf("  %-26s %s%s\n", cases[c], err ? err : "accepted", right ? "" : " (wrong)");
+        wrong += !right;
+    }
+    printf("Scene checks: %d of %d wrong\n", wrong, numCases);
+    return wrong ? 1 : 0;
+}
+
+typedef struct {
+    const RenderContext *ctx;
+    int tilesX, tilesY;
+    SDL_atomic_t traced;
+    SDL_atomic_t aovTicks;
+} TileJobs;
+
+static void tileJob(void *arg, int index) {
+    TileJobs *jobs = arg;
+    const Frame *frame = jobs->ctx->frame;
+    int tx = (index % jobs->tilesX) * TILE_SIZE;
+    int ty = (index / jobs->tilesX) * TILE_SIZE;
+    int tx1 = (tx + TILE_SIZE < frame->width) ? tx + TILE_SIZE : frame->width;
+    int ty1 = (ty + TILE_SIZE < frame->height) ? ty + TILE_SIZE : frame->height;
+    if (jobs->ctx->scene) {
+        SDL_AtomicAdd(&jobs->traced, sceneTile(jobs->ctx, index, tx, ty, tx1, ty1));
+    } else if (jobs->ctx->progressive) {
+        SDL_AtomicAdd(&jobs->traced, progressiveTile(jobs->ctx, index, tx, ty, tx1, ty1));
+    } else if (jobs->ctx->pt) {
+        pathTraceTile(jobs->ctx, tx, ty, tx1, ty1);
+        SDL_AtomicAdd(&jobs->traced, (tx1 - tx) * (ty1 - ty) * jobs->ctx->pt->sppPerFrame);
+    } else {
+        SDL_AtomicAdd(&jobs->traced, renderTile(jobs->ctx, tx, ty, tx1, ty1));
+    }
+    if (jobs->ctx->env && jobs->ctx->env->roughness >= 0 && !jobs->ctx->pt)
+        envSpecularTile(jobs->ctx, tx, ty, tx1, ty1);
+    if (jobs->ctx->aov) {
+        Uint64 start = SDL_GetPerformanceCounter();
+        writeTileAov(jobs->ctx, tx, ty, tx1, ty1);
+        SDL_AtomicAdd(&jobs->aovTicks, (int)(SDL_GetPerformanceCounter() - start));
+    }
+}
+
+// Renders the whole frame on the pool and returns the number of rays traced.
+// aovTicks, if given, receives the worker time spent filling AOVs.
+static int renderFrame(WorkerPool *pool, const RenderContext *ctx, Uint64 *aovTicks) {
+    TileJobs jobs;
+    PathTracer *pt = ctx->pt;
+    if (pt && (pt->samples == 0 || pt->angle != ctx->angle)) {
+        memset(pt->accum, 0, sizeof(float) * 3 * ctx->frame->width * ctx->frame->height);
+        pt->samples = 0;
+        pt->angle = ctx->angle;
+    }
+    Progressive *pr = ctx->progressive;
+    if (pr) {
+        // any change of angle drops all refinement and starts over at 1/8
+        if (pr->angle != ctx->angle) {
+            memset(pr->tileStep, 0, pr->numTiles);
+            pr->angle = ctx->angle;
+        }
+        pr->deadline = SDL_GetPerformanceCounter() + pr->budget;
+        SDL_AtomicSet(&pr->pending, 0);
+    }
+    jobs.ctx = ctx;
+    jobs.tilesX = (ctx->frame->width + TILE_SIZE - 1) / TILE_SIZE;
+    jobs.tilesY = (ctx->frame->height + TILE_SIZE - 1) / TILE_SIZE;
+    SDL_AtomicSet(&jobs.traced, 0);
+    SDL_AtomicSet(&jobs.aovTicks, 0);
+    poolRun(pool, tileJob, &jobs, jobs.tilesX * jobs.tilesY);
+    // coarse progressive levels hold approximate face IDs, so picking traces
+    // until every tile is at full resolution
+    int fullRes = 1;
+    for (int t = 0; pr && fullRes && t < pr->numTiles; t++)
+        fullRes = pr->tileStep[t] == 1;
+    ctx->frame->idsValid = fullRes;
+    ctx->frame->idsAngle = ctx->angle;
+    if (pt)
+        pt->samples += pt->sppPerFrame;
+    if (aovTicks)
+        *aovTicks += (unsigned)SDL_AtomicGet(&jobs.aovTicks);
+    return SDL_AtomicGet(&jobs.traced);
+}
+
+/*
+ * Viewports: several cameras on one window, laid out in a grid. They share
+ * the rotated planes and face colors of the frame, their tiles go to the
+ * pool as one batch, and they are uploaded into one texture and presented
+ * together.
+ */
+#define MAX_VIEWPORTS 9
+
+typedef struct {
+    RenderContext ctx;
+    Frame frame;
+    Background background;
+    SDL_Rect rect; // in the window
+} Viewport;
+
+typedef struct {
+    TileJobs jobs[MAX_VIEWPORTS];
+    int first[MAX_VIEWPORTS + 1]; // job index each viewport starts at
+} ViewportJobs;
+
+static void viewportJob(void *arg, int index) {
+    ViewportJobs *vj = arg;
+    int v = 0;
+    while (index >= vj->first[v + 1])
+        v++;
+    tileJob(&vj->jobs[v], index - vj->first[v]);
+}
+
+static int renderViewports(WorkerPool *pool, Viewport *views, int count) {
+    ViewportJobs vj;
+    vj.first[0] = 0;
+    for (int v = 0; v < count; v++) {
+        TileJobs *jobs = &vj.jobs[v];
+        jobs->ctx = &views[v].ctx;
+        jobs->tilesX = (views[v].frame.width + TILE_SIZE - 1) / TILE_SIZE;
+        jobs->tilesY = (views[v].frame.height + TILE_SIZE - 1) / TILE_SIZE;
+        SDL_AtomicSet(&jobs->traced, 0);
+        SDL_AtomicSet(&jobs->aovTicks, 0);
+        vj.first[v + 1] = vj.first[v] + jobs->tilesX * jobs->tilesY;
+    }
+    poolRun(pool, viewportJob, &vj, vj.first[count]);
+    int traced = 0;
+    for (int v = 0; v < count; v++) {
+        views[v].frame.idsValid = 1;
+        views[v].frame.idsAngle = views[v].ctx.angle;
+        traced += SDL_AtomicGet(&vj.jobs[v].traced);
+    }
+    return traced;
+}
+
+// Sets up the viewports named in spec ("quad" or a comma list of front,
+// top, side, persp) as copies of base. Returns the count, -1 on error.
+static int viewportsInit(Viewport *views, const char *spec, const RenderContext *base, const Background *bg) {
+    static const struct { const char *name; Vec3 pos, up; } cams[] = {
+        { "front", {  0,   0,  -5 }, { 0, 1, 0 } },
+        { "top",   {  0,   5,   0 }, { 0, 0, 1 } },
+        { "side",  {  5,   0,   0 }, { 0, 1, 0 } },
+        { "persp", {  3, 2.5,  -3 }, { 0, 1, 0 } },
+    };
+    char list[256];
+    snprintf(list, sizeof(list), "%s", strcmp(spec, "quad") ? spec : "front,top,side,persp");
+    int count = 0, which[MAX_VIEWPORTS];
+    for (char *name = strtok(list, ","); name; name = strtok(NULL, ",")) {
+        int c = 0;
+        while (c < 4 && strcmp(cams[c].name, name))
+            c++;
+        if (c == 4 || count == MAX_VIEWPORTS) {
+            fprintf(stderr, "Bad --views entry %s (front, top, side, persp, at most %d)\n", name, MAX_VIEWPORTS);
+            return -1;
+        }
+        which[count++] = c;
+    }
+    int cols = count <= 1 ? 1 : count <= 4 ? 2 : 3;
+    int rows = (count + cols - 1) / cols;
+    int w = base->frame->width / cols, h = base->frame->height / rows;
+    for (int v = 0; v < count; v++) {
+        Viewport *vp = &views[v];
+        vp->ctx = *base;
+        vp->rect = (SDL_Rect){ (v % cols) * w, (v / cols) * h, w, h };
+        vp->frame = (Frame){ w, h, malloc(sizeof(uint32_t) * w * h), malloc((size_t)w * h), 0, 0 };
+        vp->background = *bg;
+        vp->background.pixels = NULL;
+        if (!vp->frame.pixels || !vp->frame.faceIds || ensureBackground(&vp->background, w, h) < 0) {
+            fprintf(stderr, "Failed to allocate viewport %d\n", v);
+            return -1;
+        }
+        vp->ctx.frame = &vp->frame;
+        vp->ctx.background = vp->background.pixels;
+        vp->ctx.halfWidth = w / 2.0;
+        vp->ctx.halfHeight = h / 2.0;
+        vp->ctx.scaleFactor = base->scaleFactor * fmin((double)w / base->frame->width, (double)h / base->frame->height);
+        setCamera(&vp->ctx, cams[which[v]].pos, (Vec3){ 0, 0, 0 }, cams[which[v]].up);
+    }
+    return count;
+}
+
+static void viewportsFree(Viewport *views, int count) {
+    for (int v = 0; v < count; v++) {
+        free(views[v].frame.pixels);
+        free(views[v].frame.faceIds);
+        free(views[v].background.pixels);
+    }
+}
+
+/*
+ * Video wall. Each process shows one cell of a cols x rows virtual canvas:
+ * same camera, principal point shifted by the cell's offset (an off-axis
+ * frustum), scale grown with the canvas. A shared-memory block keeps the
+ * processes in step: member 0 leads and publishes the angle, everyone
+ * meets at a barrier before rendering and again before presenting, and
+ * present times are compared frame by frame for the skew report.
+ */
+#define WALL_MAGIC 0x4C4C4157 // "WALL"
+#define WALL_MAX_MEMBERS 64
+#define WALL_TIMEOUT_MS 2000
+
+typedef struct {
+    uint32_t magic;
+    int32_t members;
+    int32_t leaderPid;
+    SDL_atomic_t arrived;
+    SDL_atomic_t generation;
+    SDL_atomic_t left;      // set by a member on its way out, so nobody waits for it
+    uint32_t frame;         // written by the leader before the start barrier
+    double angle;
+    int64_t presentNs[WALL_MAX_MEMBERS]; // last present of each member, CLOCK_MONOTONIC
+} WallShared;
+
+typedef struct {
+    int cols, rows, index;
+    const char *shmName;
+    WallShared *shared;
+    int fd;
+    double skewSum, skewMax; // leader, since the last report
+    int skewFrames;
+    Uint64 waitTicks;        // time spent in barriers since the last report
+} Wall;
+
+static int64_t monotonicNs(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// Member 0 makes a fresh block; the others wait for it to appear with a
+// live leader, so a block left behind by a crashed run is not joined
+static int wallOpen(Wall *wall) {
+    WallShared *s = MAP_FAILED;
+    int members = wall->cols * wall->rows;
+    Uint32 start = SDL_GetTicks();
+    if (wall->index == 0)
+        shm_unlink(wall->shmName);
+    for (;;) {
+        int fd = (wall->index == 0) ? shm_open(wall->shmName, O_CREAT | O_EXCL | O_RDWR, 0600)
+                                    : shm_open(wall->shmName, O_RDWR, 0600);
+        if (fd >= 0 && wall->index == 0 && ftruncate(fd, sizeof(WallShared)) < 0) {
+            close(fd);
+            fd = -1;
+        }
+        struct stat st;
+        if (fd >= 0 && fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(WallShared))
+            s = mmap(NULL, sizeof(WallShared), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (s != MAP_FAILED) {
+            wall->fd = fd;
+            break;
+        }
+        if (fd >= 0)
+            close(fd);
+        if (wall->index == 0 || SDL_GetTicks() - start > 30000) {
+            fprintf(stderr, "Failed to open wall clock %s: %s\n", wall->shmName, strerror(errno));
+            return -1;
+        }
+        SDL_Delay(50);
+    }
+    wall->shared = s;
+    if (wall->index == 0) {
+        memset(s, 0, sizeof(*s));
+        s->members = members;
+        s->leaderPid = getpid();
+        SDL_MemoryBarrierRelease();
+        s->magic = WALL_MAGIC;
+        return 0;
+    }
+    while (s->magic != WALL_MAGIC || kill(s->leaderPid, 0) < 0) {
+        if (SDL_GetTicks() - start > 30000) {
+            fprintf(stderr, "No wall leader on %s\n", wall->shmName);
+            return -1;
+        }
+        SDL_Delay(50);
+    }
+    SDL_MemoryBarrierAcquire();
+    if (s->members != members) {
+        fprintf(stderr, "Wall %s has %d members, expected %d\n", wall->shmName, s->members, members);
+        return -1;
+    }
+    return 0;
+}
+
+// Central barrier on the shared block. Returns -1 if a member left or
+// stayed away for WALL_TIMEOUT_MS, after which the wall is given up.
+static int wallBarrier(Wall *wall) {
+    WallShared *s = wall->shared;
+    Uint64 start = SDL_GetPerformanceCounter();
+    int gen = SDL_AtomicGet(&s->generation);
+    if (SDL_AtomicAdd(&s->arrived, 1) == s->members - 1) {
+        SDL_AtomicSet(&s->arrived, 0);
+        SDL_AtomicAdd(&s->generation, 1);
+    } else {
+        Uint32 since = SDL_GetTicks();
+        while (SDL_AtomicGet(&s->generation) == gen) {
+            if (SDL_AtomicGet(&s->left) || SDL_GetTicks() - since > WALL_TIMEOUT_MS)
+                return -1;
+            sched_yield();
+        }
+    }
+    wall->waitTicks += SDL_GetPerformanceCounter() - start;
+    return 0;
+}
+
+// Start of a frame: the leader's angle goes to everybody. The present
+// times of the previous frame are all in by now, so the leader takes its
+// skew here.
+static int wallFrameStart(Wall *wall, double *angle) {
+    WallShared *s = wall->shared;
+    if (wall->index == 0) {
+        s->angle = *angle;
+        s->frame++;
+    }
+    if (wallBarrier(wall) < 0)
+        return -1;
+    *angle = s->angle;
+    if (wall->index == 0 && s->frame > 1) {
+        int64_t lo = INT64_MAX, hi = INT64_MIN;
+        for (int m = 0; m < s->members; m++) {
+            lo = s->presentNs[m] < lo ? s->presentNs[m] : lo;
+            hi = s->presentNs[m] > hi ? s->presentNs[m] : hi;
+        }
+        double skew = (hi - lo) / 1e6;
+        wall->skewSum += skew;
+        wall->skewMax = fmax(wall->skewMax, skew);
+        wall->skewFrames++;
+    }
+    return 0;
+}
+
+static void wallPresented(Wall *wall) {
+    wall->shared->presentNs[wall->index] = monotonicNs();
+}
+
+static void wallClose(Wall *wall) {
+    if (!wall->shared)
+        return;
+    SDL_AtomicSet(&wall->shared->left, 1);
+    munmap(wall->shared, sizeof(WallShared));
+    close(wall->fd);
+    if (wall->index == 0)
+        shm_unlink(wall->shmName);
+}
+
+typedef struct {
+    int object; // -1 when nothing is under the point
+    int face;   // plane index, or FACE_INSIDE when the camera is inside
+    double t;
+    Vec3 point;
+    int fromBuffer; // answered from the face-ID buffer without tracing
+} PickResult;
+
+// Picks the object and face under window pixel (x, y) for the planes in ctx.
+// When the last rendered face-ID buffer matches ctx->angle the lookup is a
+// single read; otherwise one analytic ray goes through the same plane test.
+static PickResult pickAt(const RenderContext *ctx, int x, int y) {
+    PickResult r = { -1, FACE_MISS, 0, {0, 0, 0}, 0 };
+    const Frame *frame = ctx->frame;
+    Vec3 rayDir = pixelRay(ctx, x, y);
+    uint8_t f;
+    double tNear = 0, tFar = 0;
+    if (ctx->scene) {
+        // face IDs alone don't say which instance, so scenes always trace
+        int item = sceneTraceRay(ctx, rayDir, &r.t, &f);
+        if (item < 0 || ctx->scene->items[item].instance < 0)
+            return r;
+        r.object = ctx->scene->items[item].instance;
+        r.face = f;
+        r.point = add(ctx->camPos, scale(rayDir, r.t));
+        return r;
+    }
+    if (frame->idsValid && frame->idsAngle == ctx->angle &&
+        x >= 0 && y >= 0 && x < frame->width && y < frame->height) {
+        f = frame->faceIds[y * frame->width + x];
+        r.fromBuffer = 1;
+        if (f == FACE_INSIDE)
+            traceRay(ctx->planes, ctx->numPlanes, ctx->camPos, rayDir, &tNear, &tFar);
+    } else {
+        f = traceRay(ctx->planes, ctx->numPlanes, ctx->camPos, rayDir, &tNear, &tFar);
+    }
+    if (f == FACE_MISS)
+        return r;
+    r.object = 0;
+    r.face = f;
+    if (f < ctx->numPlanes) {
+        const Plane *p = &ctx->planes[f];
+        r.t = (p->d - dot(p->n, ctx->camPos)) / dot(p->n, rayDir);
+    } else {
+        r.t = (tNear >= 0) ? tNear : tFar;
+    }
+    r.point = add(ctx->camPos, scale(rayDir, r.t));
+    return r;
+}
+
+#define RAY_JOB_SIZE 4096
+
+typedef struct {
+    const Plane *planes;
+    int numPlanes;
+    const RayBatch *batch;
+} RayJobs;
+
+static void rayJob(void *arg, int index) {
+    const RayJobs *jobs = arg;
+    const RayBatch *all = jobs->batch;
+    int base = index * RAY_JOB_SIZE;
+    RayBatch part = {
+        all->ox + base, all->oy + base, all->oz + base,
+        all->dx + base, all->dy + base, all->dz + base,
+        all->tNear + base, all->tFar + base, all->face + base,
+        (all->count - base < RAY_JOB_SIZE) ? all->count - base : RAY_JOB_SIZE,
+        all->exitFace ? all->exitFace + base : NULL
+    };
+    traceRays(jobs->planes, jobs->numPlanes, &part);
+}
+
+// traceRays() split into RAY_JOB_SIZE chunks across the pool
+void traceRaysParallel(WorkerPool *pool, const Plane *planes, int numPlanes, const RayBatch *batch) {
+    RayJobs jobs = { planes, numPlanes, batch };
+    poolRun(pool, rayJob, &jobs, (batch->count + RAY_JOB_SIZE - 1) / RAY_JOB_SIZE);
+}
+
+typedef struct {
+    const Plane *planes;
+    int numPlanes;
+    const PointBatch *batch;
+} PointJobs;
+
+static void pointJob(void *arg, int index) {
+    const PointJobs *jobs = arg;
+    const PointBatch *all = jobs->batch;
+    int base = index * RAY_JOB_SIZE;
+    PointBatch part = {
+        all->px + base, all->py + base, all->pz + base,
+        all->cls + base, all->dist ? all->dist + base : NULL,
+        (all->count - base < RAY_JOB_SIZE) ? all->count - base : RAY_JOB_SIZE
+    };
+    classifyPoints(jobs->planes, jobs->numPlanes, &part);
+}
+
+void classifyPointsParallel(WorkerPool *pool, const Plane *planes, int numPlanes, const PointBatch *batch) {
+    PointJobs jobs = { planes, numPlanes, batch };
+    poolRun(pool, pointJob, &jobs, (batch->count + RAY_JOB_SIZE - 1) / RAY_JOB_SIZE);
+}
+
+static double uniformRand(void) {
+    return rand() / (RAND_MAX + 1.0);
+}
+
+// Throughput of the scalar, batch and pooled kernels on random rays aimed
+// near the solid, in rays per second
+static int benchRays(const Plane *planes, int numPlanes, int count, int threads) {
+    double *mem = malloc(sizeof(double) * 8 * (size_t)count);
+    uint8_t *face = malloc((size_t)count);
+    if (!mem || !face) {
+        fprintf(stderr, "Failed to allocate %d rays\n", count);
+        free(mem);
+        free(face);
+        return 1;
+    }
+    RayBatch batch = {
+        mem, mem + count, mem + 2 * (size_t)count,
+        mem + 3 * (size_t)count, mem + 4 * (size_t)count, mem + 5 * (size_t)count,
+        mem + 6 * (size_t)count, mem + 7 * (size_t)count, face, count, NULL
+    };
+    double *o[3] = { mem, mem + count, mem + 2 * (size_t)count };
+    double *d[3] = { mem + 3 * (size_t)count, mem + 4 * (size_t)count, mem + 5 * (size_t)count };
+    for (int k = 0; k < count; k++) {
+        Vec3 origin = scale(normalize((Vec3){ uniformRand() - 0.5, uniformRand() - 0.5, uniformRand() - 0.5 }), 3);
+        Vec3 target = { uniformRand() - 0.5, uniformRand() - 0.5, uniformRand() - 0.5 };
+        Vec3 dir = normalize(subtract(target, origin));
+        o[0][k] = origin.x; o[1][k] = origin.y; o[2][k] = origin.z;
+        d[0][k] = dir.x; d[1][k] = dir.y; d[2][k] = dir.z;
+    }
+    double freq = (double)SDL_GetPerformanceFrequency();
+
+    Uint64 start = SDL_GetPerformanceCounter();
+    int hits = 0;
+    for (int k = 0; k < count; k++) {
+        Vec3 origin = { o[0][k], o[1][k], o[2][k] }, dir = { d[0][k], d[1][k], d[2][k] };
+        hits += traceRay(planes, numPlanes, origin, dir, NULL, NULL) != FACE_MISS;
+    }
+    double scalarSec = (SDL_GetPerformanceCounter() - start) / freq;
+
+    start = SDL_GetPerformanceCounter();
+    traceRays(planes, numPlanes, &batch);
+    double batchSec = (SDL_GetPerformanceCounter() - start) / freq;
+
+    WorkerPool pool;
+    if (poolInit(&pool, threads) < 0) {
+        free(mem);
+        free(face);
+        return 1;
+    }
+    start = SDL_GetPerformanceCounter();
+    traceRaysParallel(&pool, planes, numPlanes, &batch);
+    double parallelSec = (SDL_GetPerformanceCounter() - start) / freq;
+    poolDestroy(&pool);
+
+    // the kernels promise the same bits as traceRay, which needs FP contraction off
+    int mismatches = 0;
+    for (int k = 0; k < count; k++) {
+        Vec3 origin = { o[0][k], o[1][k], o[2][k] }, dir = { d[0][k], d[1][k], d[2][k] };
+        double tNear, tFar;
+        uint8_t f = traceRay(planes, numPlanes, origin, dir, &tNear, &tFar);
+        mismatches += f != batch.face[k] || memcmp(&tNear, &batch.tNear[k], sizeof(double)) ||
+                      memcmp(&tFar, &batch.tFar[k], sizeof(double));
+    }
+
+    printf("Rays: %d, planes: %d, hit: %.1f%%, differing from traceRay: %d\n", count, numPlanes,
+           100.0 * hits / count, mismatches);
+    printf("  scalar traceRay:  %.2f Mrays/s\n", count / scalarSec / 1e6);
+    printf("  batch traceRays:  %.2f Mrays/s\n", count / batchSec / 1e6);
+    printf("  %2d threads:       %.2f Mrays/s\n", threads, count / parallelSec / 1e6);
+    free(mem);
+    free(face);
+    return mismatches ? 1 : 0;
+}
+
+// Containment throughput on random points in the solid's bounding cube
+static int benchPoints(const Plane *planes, int numPlanes, int count, int threads) {
+    double *mem = malloc(sizeof(double) * 4 * (size_t)count);
+    uint8_t *cls = malloc((size_t)count);
+    if (!mem || !cls) {
+        fprintf(stderr, "Failed to allocate %d points\n", count);
+        free(mem);
+        free(cls);
+        return 1;
+    }
+    PointBatch batch = { mem, mem + count, mem + 2 * (size_t)count, cls, mem + 3 * (size_t)count, count };
+    for (size_t k = 0; k < 3 * (size_t)count; k++)
+        mem[k] = 2 * uniformRand() - 1;
+    double freq = (double)SDL_GetPerformanceFrequency();
+
+    Uint64 start = SDL_GetPerformanceCounter();
+    classifyPoints(planes, numPlanes, &batch);
+    double batchSec = (SDL_GetPerformanceCounter() - start) / freq;
+
+    WorkerPool pool;
+    if (poolInit(&pool, threads) < 0) {
+        free(mem);
+        free(cls);
+        return 1;
+    }
+    start = SDL_GetPerformanceCounter();
+    classifyPointsParallel(&pool, planes, numPlanes, &batch);
+    double parallelSec = (SDL_GetPerformanceCounter() - start) / freq;
+    poolDestroy(&pool);
+
+    int counts[3] = { 0, 0, 0 };
+    for (int k = 0; k < count; k++)
+        counts[cls[k]]++;
+    printf("Points: %d, planes: %d, inside: %d, on surface: %d, outside: %d\n",
+           count, numPlanes, counts[POINT_INSIDE], counts[POINT_ON_SURFACE], counts[POINT_OUTSIDE]);
+    printf("  batch classifyPoints: %.2f Mpoints/s\n", count / batchSec / 1e6);
+    printf("  %2d threads:           %.2f Mpoints/s\n", threads, count / parallelSec / 1e6);
+    free(mem);
+    free(cls);
+    return 0;
+}
+
+/*
+ * Voxelizer / SDF baker. The grid is a cube of side 2 * extent centered on
+ * the origin, sampled at voxel centers, x fastest. Every plane value is
+ * linear along each axis, so a slab (one z slice) keeps per-plane row
+ * offsets and steps them by n.y * h and n.z * h instead of re-evaluating
+ * dot products. The x loop is a max over a linear ramp, which vectorizes.
+ */
+typedef struct {
+    const Plane *planes;
+    int numPlanes;
+    int res;
+    double origin, step;
+    int sdf;
+    uint8_t *out; // the mapped file
+    SDL_atomic_t failed; // slabs left unwritten
+} VoxelJobs;
+
+static void voxelSlabJob(void *arg, int z) {
+    VoxelJobs *jobs = arg;
+    int res = jobs->res;
+    double rowStart[MAX_PLANES], xStep[MAX_PLANES], yStep[MAX_PLANES];
+    float *dist = malloc(sizeof(float) * res);
+    if (!dist) {
+        SDL_AtomicAdd(&jobs->failed, 1);
+        return;
+    }
+    double p0 = jobs->origin + 0.5 * jobs->step;
+    double pz = p0 + z * jobs->step;
+    for (int i = 0; i < jobs->numPlanes; i++) {
+        const Plane *p = &jobs->planes[i];
+        rowStart[i] = p->n.x * p0 + p->n.y * p0 + p->n.z * pz - p->d;
+        xStep[i] = p->n.x * jobs->step;
+        yStep[i] = p->n.y * jobs->step;
+    }
+    size_t slab = (size_t)z * res * res;
+    for (int y = 0; y < res; y++) {
+        for (int x = 0; x < res; x++)
+            dist[x] = -1e30f;
+        for (int i = 0; i < jobs->numPlanes; i++) {
+            float v0 = (float)rowStart[i], dv = (float)xStep[i];
+            for (int x = 0; x < res; x++) {
+                float v = v0 + dv * x;
+                dist[x] = v > dist[x] ? v : dist[x];
+            }
+            rowStart[i] += yStep[i];
+        }
+        size_t row = slab + (size_t)y * res;
+        if (jobs->sdf) {
+            memcpy((float *)jobs->out + row, dist, sizeof(float) * res);
+        } else {
+            uint8_t *out = jobs->out + row;
+            for (int x = 0; x < res; x++)
+                out[x] = dist[x] <= 0 ? 255 : 0;
+        }
+    }
+    free(dist);
+}
+
+// Writes a res^3 raw volume (uint8 occupancy or float32 SDF) straight into a
+// memory-mapped file, plus a detached NRRD header next to it
+static int voxelize(WorkerPool *pool, const Plane *planes, int numPlanes, double extent,
+                    int res, const char *path, int sdf) {
+    size_t voxel = sdf ? sizeof(float) : 1;
+    size_t size = (size_t)res * res * res * voxel;
+    int fd = open(path, O_CREAT | O_RDWR | O_TRUNC, 0644);
+    if (fd < 0 || ftruncate(fd, (off_t)size) < 0) {
+        perror(path);
+        if (fd >= 0)
+            close(fd);
+        return 1;
+    }
+    uint8_t *out = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (out == MAP_FAILED) {
+        perror("voxel mmap");
+        return 1;
+    }
+    VoxelJobs jobs = { planes, numPlanes, res, -extent, 2 * extent / res, sdf, out, { 0 } };
+    Uint64 start = SDL_GetPerformanceCounter();
+    poolRun(pool, voxelSlabJob, &jobs, res);
+    double sec = (SDL_GetPerformanceCounter() - start) / (double)SDL_GetPerformanceFrequency();
+    munmap(out, size);
+    if (SDL_AtomicGet(&jobs.failed)) {
+        fprintf(stderr, "Out of memory for %d of %d slabs, removed %s\n", SDL_AtomicGet(&jobs.failed), res, path);
+        unlink(path);
+        return 1;
+    }
+
+    char header[1024];
+    snprintf(header, sizeof(header), "%s.nhdr", path);
+    FILE *f = fopen(header, "w");
+    if (f) {
+        const char *base = strrchr(path, '/');
+        fprintf(f, "NRRD0004\ntype: %s\ndimension: 3\nsizes: %d %d %d\n"
+                   "space dimension: 3\nspace directions: (%g,0,0) (0,%g,0) (0,0,%g)\n"
+                   "space origin: (%g,%g,%g)\nendian: little\nencoding: raw\ndata file: %s\n",
+                sdf ? "float" : "uint8", res, res, res, jobs.step, jobs.step, jobs.step,
+                jobs.origin + 0.5 * jobs.step, jobs.origin + 0.5 * jobs.step, jobs.origin + 0.5 * jobs.step,
+                base ? base + 1 : path);
+        fclose(f);
+    }
+    printf("Voxelized %d^3 %s into %s in %.3f s (%.1f Mvoxels/s)\n", res, sdf ? "SDF" : "occupancy",
+           path, sec, (double)res * res * res / sec / 1e6);
+    return 0;
+}
+
+static size_t aovLayout(AovBuffers *aov, uint8_t *base, int width, int height) {
+    size_t n = (size_t)width * height;
+    size_t off = sizeof(AovHeader);
+    aov->header = (AovHeader *)base;
+    aov->depth = (uint16_t *)(base + off);
+    off += n * sizeof(uint16_t);
+    aov->normal = (uint16_t *)(base + off);
+    off += n * sizeof(uint16_t);
+    aov->faceIds = base + off;
+    off += (n + 1) & ~(size_t)1;
+    aov->position = (uint16_t *)(base + off);
+    off += 3 * n * sizeof(uint16_t);
+    return off;
+}
+
+// AOVs live either in a malloc'd block that is dumped to disk every frame,
+// or directly in a shared memory segment readers can map
+static int aovInit(AovBuffers *aov, const Options *opts, int width, int height) {
+    memset(aov, 0, sizeof(*aov));
+    aov->shmFd = -1;
+    aov->dumpPrefix = opts->aovDump;
+    size_t size = aovLayout(aov, NULL, width, height);
+    uint8_t *base;
+    if (opts->aovShm) {
+        aov->shmFd = shm_open(opts->aovShm, O_CREAT | O_RDWR, 0600);
+        if (aov->shmFd < 0 || ftruncate(aov->shmFd, (off_t)size) < 0) {
+            perror("AOV shared memory");
+            return -1;
+        }
+        base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, aov->shmFd, 0);
+        if (base == MAP_FAILED) {
+            perror("AOV mmap");
+            return -1;
+        }
+    } else {
+        base = calloc(1, size);
+        if (!base)
+            return -1;
+    }
+    aov->size = size;
+    aovLayout(aov, base, width, height);
+    aov->header->magic = AOV_MAGIC;
+    aov->header->version = 1;
+    aov->header->width = (uint32_t)width;
+    aov->header->height = (uint32_t)height;
+    aov->header->depthNear = 0.0f;
+    aov->header->depthFar = 10.0f;
+    return 0;
+}
+
+static void aovFree(AovBuffers *aov, const char *shmName) {
+    if (!aov->header)
+        return;
+    if (aov->shmFd >= 0) {
+        munmap(aov->header, aov->size);
+        close(aov->shmFd);
+        shm_unlink(shmName);
+    } else {
+        free(aov->header);
+    }
+}
+
+// Shared memory readers retry while seq is odd or changed under them
+static void aovBeginFrame(AovBuffers *aov) {
+    aov->header->seq++;
+    SDL_MemoryBarrierRelease();
+}
+
+static void aovEndFrame(AovBuffers *aov, const Frame *frame, uint32_t frameNumber) {
+    memcpy(aov->faceIds, frame->faceIds, (size_t)frame->width * frame->height);
+    aov->header->frame = frameNumber;
+    SDL_MemoryBarrierRelease();
+    aov->header->seq++;
+    if (aov->dumpPrefix) {
+        char path[1024];
+        snprintf(path, sizeof(path), "%s_%06u.aov", aov->dumpPrefix, frameNumber);
+        FILE *f = fopen(path, "wb");
+        if (!f || fwrite(aov->header, 1, aov->size, f) != aov->size)
+            fprintf(stderr, "Failed to write %s\n", path);
+        if (f)
+            fclose(f);
+    }
+}
+
+/*
+ * Post-processing. Bloom works on a half and quarter resolution planar float
+ * pyramid so the blurs are cheap and vectorize cleanly. Over the full frame
+ * there are exactly two passes: postDownsample reads the shaded pixels into
+ * the half level, postComposite reads pixels and face IDs once more and
+ * writes outline + bloom + LUT grade back in place.
+ */
+#define POST_LEVELS 2
+
+typedef struct {
+    int w, h;
+    float *rgb[3];
+    float *tmp[3];
+} BloomLevel;
+
+typedef struct {
+    const PostOptions *opts;
+    Frame *frame;
+    BloomLevel level[POST_LEVELS];
+    int rowsPerJob;
+    float *rowScratch; // one vertically interpolated half row per composite job
+} PostContext;
+
+static const float blurKernel[5] = { 0.0625f, 0.25f, 0.375f, 0.25f, 0.0625f };
+
+static int postInit(PostContext *post, const PostOptions *opts, Frame *frame) {
+    memset(post, 0, sizeof(*post));
+    post->opts = opts;
+    post->frame = frame;
+    post->rowsPerJob = 8;
+    int w = frame->width, h = frame->height;
+    for (int l = 0; l < POST_LEVELS; l++) {
+        w = (w + 1) / 2;
+        h = (h + 1) / 2;
+        post->level[l].w = w;
+        post->level[l].h = h;
+        for (int c = 0; c < 3; c++) {
+            post->level[l].rgb[c] = calloc((size_t)w * h, sizeof(float));
+            post->level[l].tmp[c] = calloc((size_t)w * h, sizeof(float));
+            if (!post->level[l].rgb[c] || !post->level[l].tmp[c])
+                return -1;
+        }
+    }
+    int jobs = (frame->height + post->rowsPerJob - 1) / post->rowsPerJob;
+    post->rowScratch = malloc(sizeof(float) * 3 * post->level[0].w * jobs);
+    return post->rowScratch ? 0 : -1;
+}
+
+static void postFree(PostContext *post) {
+    for (int l = 0; l < POST_LEVELS; l++) {
+        for (int c = 0; c < 3; c++) {
+            free(post->level[l].rgb[c]);
+            free(post->level[l].tmp[c]);
+        }
+    }
+    free(post->rowScratch);
+}
+
+// Pass 1: bright-pass of the lit faces, box-downsampled to half resolution
+static void postDownsampleJob(void *arg, int index) {
+    PostContext *post = arg;
+    const Frame *frame = post->frame;
+    BloomLevel *dst = &post->level[0];
+    float thr = post->opts->bloomThreshold;
+    float knee = 1.0f / (1.0f - thr);
+    int y0 = index * post->rowsPerJob;
+    int y1 = (y0 + post->rowsPerJob < dst->h) ? y0 + post->rowsPerJob : dst->h;
+    for (int hy = y0; hy < y1; hy++) {
+        for (int hx = 0; hx < dst->w; hx++) {
+            float sum[3] = { 0, 0, 0 };
+            for (int s = 0; s < 4; s++) {
+                int x = hx * 2 + (s & 1), y = hy * 2 + (s >> 1);
+                if (x >= frame->width) x = frame->width - 1;
+                if (y >= frame->height) y = frame->height - 1;
+                if (frame->faceIds[y * frame->width + x] >= FACE_UNTRACED)
+                    continue; // only the lit faces glow, not the background
+                uint32_t p = frame->pixels[y * frame->width + x];
+                float r = ((p >> 16) & 0xFF) / 255.0f;
+                float g = ((p >> 8) & 0xFF) / 255.0f;
+                float b = (p & 0xFF) / 255.0f;
+                float k = (0.2126f * r + 0.7152f * g + 0.0722f * b - thr) * knee;
+                if (k <= 0)
+                    continue;
+                sum[0] += r * k;
+                sum[1] += g * k;
+                sum[2] += b * k;
+            }
+            for (int c = 0; c < 3; c++)
+                dst->rgb[c][hy * dst->w + hx] = sum[c] * 0.25f;
+        }
+    }
+}
+
+// Half -> quarter box downsample, one destination row per job
+static void postPyramidJob(void *arg, int index) {
+    PostContext *post = arg;
+    const BloomLevel *src = &post->level[0];
+    BloomLevel *dst = &post->level[1];
+    int y0 = 2 * index, y1 = (2 * index + 1 < src->h) ? 2 * index + 1 : src->h - 1;
+    for (int c = 0; c < 3; c++) {
+        const float *a = src->rgb[c] + y0 * src->w;
+        const float *b = src->rgb[c] + y1 * src->w;
+        float *out = dst->rgb[c] + index * dst->w;
+        for (int x = 0; x < dst->w; x++) {
+            int x0 = 2 * x, x1 = (2 * x + 1 < src->w) ? 2 * x + 1 : src->w - 1;
+            out[x] = 0.25f * (a[x0] + a[x1] + b[x0] + b[x1]);
+        }
+    }
+}
+
+// Separable 5-tap blur; jobs are (level, row) pairs flattened into one index
+static void postBlurRow(const BloomLevel *lv, int y, int vertical) {
+    for (int c = 0; c < 3; c++) {
+        if (!vertical) {
+            const float *restrict in = lv->rgb[c] + y * lv->w;
+            float *restrict out = lv->tmp[c] + y * lv->w;
+            for (int x = 0; x < lv->w; x++) {
+                if (x == 2 && lv->w > 4) {
+                    // clamp-free interior so the loop vectorizes
+                    for (; x < lv->w - 2; x++) {
+                        out[x] = blurKernel[0] * in[x - 2] + blurKernel[1] * in[x - 1] +
+                                 blurKernel[2] * in[x] + blurKernel[3] * in[x + 1] +
+                                 blurKernel[4] * in[x + 2];
+                    }
+                }
+                float acc = 0;
+                for (int k = -2; k <= 2; k++) {
+                    int sx = x + k;
+                    sx = sx < 0 ? 0 : (sx >= lv->w ? lv->w - 1 : sx);
+                    acc += blurKernel[k + 2] * in[sx];
+                }
+                out[x] = acc;
+            }
+        } else {
+            const float *rows[5];
+            for (int k = -2; k <= 2; k++) {
+                int sy = y + k;
+                sy = sy < 0 ? 0 : (sy >= lv->h ? lv->h - 1 : sy);
+                rows[k + 2] = lv->tmp[c] + sy * lv->w;
+            }
+            float *restrict out = lv->rgb[c] + y * lv->w;
+            for (int x = 0; x < lv->w; x++) {
+                out[x] = blurKernel[0] * rows[0][x] + blurKernel[1] * rows[1][x] +
+                         blurKernel[2] * rows[2][x] + blurKernel[3] * rows[3][x] +
+                         blurKernel[4] * rows[4][x];
+            }
+        }
+    }
+}
+
+static void postBlurJob(PostContext *post, int index, int vertical) {
+    int l = 0;
+    while (index >= post->level[l].h) {
+        index -= post->level[l].h;
+        l++;
+    }
+    postBlurRow(&post->level[l], index, vertical);
+}
+
+static void postBlurHJob(void *arg, int index) { postBlurJob(arg, index, 0); }
+static void postBlurVJob(void *arg, int index) { postBlurJob(arg, index, 1); }
+
+// Bilinear upsample-add of the quarter level into the half level, so the
+// composite pass only has one bloom level to sample
+static void postUpsampleJob(void *arg, int index) {
+    PostContext *post = arg;
+    BloomLevel *dst = &post->level[0];
+    const BloomLevel *src = &post->level[1];
+    float sy = index * 0.5f - 0.25f;
+    if (sy < 0) sy = 0;
+    int y0 = (int)sy, y1 = (y0 + 1 < src->h) ? y0 + 1 : y0;
+    float fy = sy - y0;
+    for (int c = 0; c < 3; c++) {
+        const float *a = src->rgb[c] + y0 * src->w;
+        const float *b = src->rgb[c] + y1 * src->w;
+        float *out = dst->rgb[c] + index * dst->w;
+        for (int x = 0; x < dst->w; x++) {
+            float sx = x * 0.5f - 0.25f;
+            if (sx < 0) sx = 0;
+            int x0 = (int)sx, x1 = (x0 + 1 < src->w) ? x0 + 1 : x0;
+            float fx = sx - x0;
+            float top = a[x0] + (a[x1] - a[x0]) * fx;
+            float bot = b[x0] + (b[x1] - b[x0]) * fx;
+            out[x] += top + (bot - top) * fy;
+        }
+    }
+}
+
+static void lutLookup(const PostOptions *opts, float rgb[3]) {
+    int n = opts->lutSize;
+    float f[3];
+    int i0[3], i1[3];
+    for (int c = 0; c < 3; c++) {
+        float v = rgb[c] < 0 ? 0 : (rgb[c] > 1 ? 1 : rgb[c]);
+        v *= (n - 1);
+        i0[c] = (int)v;
+        i1[c] = (i0[c] + 1 < n) ? i0[c] + 1 : i0[c];
+        f[c] = v - i0[c];
+    }
+    float out[3] = { 0, 0, 0 };
+    for (int corner = 0; corner < 8; corner++) {
+        int r = (corner & 1) ? i1[0] : i0[0];
+        int g = (corner & 2) ? i1[1] : i0[1];
+        int b = (corner & 4) ? i1[2] : i0[2];
+        float w = ((corner & 1) ? f[0] : 1 - f[0]) *
+                  ((corner & 2) ? f[1] : 1 - f[1]) *
+                  ((corner & 4) ? f[2] : 1 - f[2]);
+        const float *e = &opts->lut[3 * (r + n * (g + n * b))];
+        out[0] += w * e[0];
+        out[1] += w * e[1];
+        out[2] += w * e[2];
+    }
+    rgb[0] = out[0];
+    rgb[1] = out[1];
+    rgb[2] = out[2];
+}
+
+// Pass 2: outline from face IDs, bloom add and LUT grade, written in place
+static void postCompositeJob(void *arg, int index) {
+    PostContext *post = arg;
+    const PostOptions *opts = post->opts;
+    Frame *frame = post->frame;
+    int w = frame->width;
+    const BloomLevel *half = &post->level[0];
+    float *glow[3];
+    for (int c = 0; c < 3; c++)
+        glow[c] = post->rowScratch + (size_t)(3 * index + c) * half->w;
+    uint32_t lastIn = 0xFFFFFFFF, lastOut = 0;
+    int y0 = index * post->rowsPerJob;
+    int y1 = (y0 + post->rowsPerJob < frame->height) ? y0 + post->rowsPerJob : frame->height;
+    for (int y = y0; y < y1; y++) {
+        if (opts->bloom) {
+            float sy = y * 0.5f - 0.25f;
+            if (sy < 0) sy = 0;
+            int hy0 = (int)sy, hy1 = (hy0 + 1 < half->h) ? hy0 + 1 : hy0;
+            float fy = sy - hy0;
+            for (int c = 0; c < 3; c++) {
+                const float *restrict a = half->rgb[c] + hy0 * half->w;
+                const float *restrict b = half->rgb[c] + hy1 * half->w;
+                float *restrict out = glow[c];
+                for (int k = 0; k < half->w; k++)
+                    out[k] = opts->bloomStrength * (a[k] + (b[k] - a[k]) * fy);
+            }
+        }
+        for (int x = 0; x < w; x++) {
+            uint32_t *p = &frame->pixels[y * w + x];
+            if (opts->outline) {
+                uint8_t id = frame->faceIds[y * w + x];
+                uint8_t right = (x + 1 < w) ? frame->faceIds[y * w + x + 1] : id;
+                uint8_t down = (y + 1 < frame->height) ? frame->faceIds[(y + 1) * w + x] : id;
+                if (id != right || id != down) {
+                    *p = 0x000000;
+                    continue;
+                }
+            }
+            if (!opts->bloom && !opts->lut)
+                continue;
+            float rgb[3] = { ((*p >> 16) & 0xFF) / 255.0f, ((*p >> 8) & 0xFF) / 255.0f, (*p & 0xFF) / 255.0f };
+            if (opts->bloom) {
+                float sx = x * 0.5f - 0.25f;
+                if (sx < 0) sx = 0;
+                int k0 = (int)sx, k1 = (k0 + 1 < half->w) ? k0 + 1 : k0;
+                float fx = sx - k0;
+                for (int c = 0; c < 3; c++)
+                    rgb[c] += glow[c][k0] + (glow[c][k1] - glow[c][k0]) * fx;
+            }
+            int r = (int)(rgb[0] * 255 + 0.5f), g = (int)(rgb[1] * 255 + 0.5f), b = (int)(rgb[2] * 255 + 0.5f);
+            r = r > 255 ? 255 : (r < 0 ? 0 : r);
+            g = g > 255 ? 255 : (g < 0 ? 0 : g);
+            b = b > 255 ? 255 : (b < 0 ? 0 : b);
+            uint32_t out = (uint32_t)((r << 16) | (g << 8) | b);
+            if (opts->lut) {
+                // flat faces give long runs of identical inputs
+                if (out != lastIn) {
+                    float in[3] = { r / 255.0f, g / 255.0f, b / 255.0f };
+                    lutLookup(opts, in);
+                    lastIn = out;
+                    r = (int)(in[0] * 255 + 0.5f);
+                    g = (int)(in[1] * 255 + 0.5f);
+                    b = (int)(in[2] * 255 + 0.5f);
+                    r = r > 255 ? 255 : (r < 0 ? 0 : r);
+                    g = g > 255 ? 255 : (g < 0 ? 0 : g);
+                    b = b > 255 ? 255 : (b < 0 ? 0 : b);
+                    lastOut = (uint32_t)((r << 16) | (g << 8) | b);
+                }
+                out = lastOut;
+            }
+            *p = out;
+        }
+    }
+}
+
+static void postProcess(WorkerPool *pool, PostContext *post) {
+    const PostOptions *opts = post->opts;
+    if (opts->bloom) {
+        const BloomLevel *half = &post->level[0], *quarter = &post->level[1];
+        poolRun(pool, postDownsampleJob, post, (half->h + post->rowsPerJob - 1) / post->rowsPerJob);
+        poolRun(pool, postPyramidJob, post, quarter->h);
+        poolRun(pool, postBlurHJob, post, half->h + quarter->h);
+        poolRun(pool, postBlurVJob, post, half->h + quarter->h);
+        poolRun(pool, postUpsampleJob, post, half->h);
+    }
+    if (opts->bloom || opts->outline || opts->lut)
+        poolRun(pool, postCompositeJob, post, (post->frame->height + post->rowsPerJob - 1) / post->rowsPerJob);
+}
+
+// Built-in grade: mild S-curve with a warm shift
+static int buildWarmLut(PostOptions *opts) {
+    int n = 17;
+    opts->lut = malloc(sizeof(float) * 3 * n * n * n);
+    if (!opts->lut)
+        return -1;
+    opts->lutSize = n;
+    for (int b = 0; b < n; b++) {
+        for (int g = 0; g < n; g++) {
+            for (int r = 0; r < n; r++) {
+                float in[3] = { r / (float)(n - 1), g / (float)(n - 1), b / (float)(n - 1) };
+                float *e = &opts->lut[3 * (r + n * (g + n * b))];
+                for (int c = 0; c < 3; c++) {
+                    float v = in[c];
+                    e[c] = v * v * (3 - 2 * v) * 0.6f + v * 0.4f;
+                }
+                e[0] = e[0] * 1.06f > 1 ? 1 : e[0] * 1.06f;
+                e[2] *= 0.9f;
+            }
+        }
+    }
+    return 0;
+}
+
+// Loads a 3D LUT in the Adobe/Resolve .cube text format
+static int loadCubeLut(const char *path, PostOptions *opts) {
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        fprintf(stderr, "Failed to open LUT %s\n", path);
+        return -1;
+    }
+    char line[256];
+    int n = 0, count = 0;
+    while (fgets(line, sizeof(line), f)) {
+        float r, g, b;
+        if (line[0] == '#' || line[0] == '\n')
+            continue;
+        if (sscanf(line, "LUT_3D_SIZE %d", &n) == 1) {
+            if (n < 2 || n > 256)
+                break;
+            opts->lut = malloc(sizeof(float) * 3 * n * n * n);
+            if (!opts->lut)
+                break;
+            opts->lutSize = n;
+        } else if (opts->lut && count < n * n * n && sscanf(line, "%f %f %f", &r, &g, &b) == 3) {
+            opts->lut[3 * count + 0] = r;
+            opts->lut[3 * count + 1] = g;
+            opts->lut[3 * count + 2] = b;
+            count++;
+        }
+    }
+    fclose(f);
+    if (!opts->lut || count != n * n * n) {
+        fprintf(stderr, "Invalid LUT %s\n", path);
+        free(opts->lut);
+        opts->lut = NULL;
+        return -1;
+    }
+    return 0;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "Usage: %s [options]\n"
+            "  --fovea R        full resolution within R px of the center, coarser outside\n"
+            "  --fovea-outer R  outer edge of the 1/2 resolution ring (default 2 * fovea)\n"
+            "  --threads N      tile worker threads including the main thread (default: CPU count)\n"
+            "  --bloom [S]      bloom on the lit faces with strength S (default 0.6)\n"
+            "  --outline        screen-space outlines at face ID changes\n"
+            "  --lut FILE|warm  3D LUT color grade from a .cube file or the built-in warm grade\n"
+            "  --aov-dump P     write depth/normal/face ID/position AOVs to P_<frame>.aov\n"
+            "  --aov-shm NAME   publish the AOVs in POSIX shared memory NAME (e.g. /dodeca-aov)\n"
+            "  --bench-rays N   measure batch ray query throughput on N random rays and exit\n"
+            "  --bench-points N measure batch point containment throughput on N points and exit\n"
+            "  --voxelize N F   write an N^3 uint8 occupancy volume to F (+ F.nhdr) and exit\n"
+            "  --sdf            with --voxelize, write a float32 signed distance volume instead\n"
+            "  --export-mesh F  triangulate the faces into F (.stl, .ply or .obj) and exit\n"
+            "  --pathtrace [N]  progressive path tracing, N samples per pixel per frame (default 1);\n"
+            "                   press space to pause the rotation and let samples accumulate\n"
+            "  --progressive [MS] show 1/8 resolution at once and refine while the view is static,\n"
+            "                   spending up to MS ms per frame on refinement (default 12)\n"
+            "  --ibl [FILE]     light with an equirectangular BMP environment (default: built-in sky)\n"
+            "  --specular R     add prefiltered environment reflections of roughness R (0..1) to --ibl\n"
+            "  --background B   RRGGBB, gradient[:TOP:BOTTOM] or a BMP file (default 00FF00)\n"
+            "  --xray [A]       see-through faces, front and back blended at opacity A (default 0.5)\n"
+            "  --absorb [S]     tinted glass: Beer-Lambert absorption with density S (default 2)\n"
+            "  --aa             exact analytic coverage anti-aliasing on face and silhouette edges\n"
+            "  --bench-aa N     compare --aa with 16x supersampling over N frames and exit\n"
+            "  --record F       record the face ID frames to F (delta + RLE, keyframe every 60)\n"
+            "  --play F         play back a recording; space pauses, left/right seek, Home restarts\n"
+            "  --bench-play F   measure compression and decode speed of recording F and exit\n"
+            "  --control PATH   take live commands on Unix socket PATH, one per line:\n"
+            "                   threads N, speed X, kernel scalar|batch, resolution WxH,\n"
+            "                   background B, stats\n"
+            "  --metrics PORT   serve Prometheus metrics on http://127.0.0.1:PORT/metrics\n"
+            "  --stream PORT    stream the frames to viewers connecting on TCP PORT\n"
+            "  --view HOST:PORT show the frames streamed by another instance\n"
+            "  --views V        split the window into viewports: quad, or a list of\n"
+            "                   front, top, side and persp (e.g. front,top,side)\n"
+            "  --wall CxR:I     be cell I (row-major from 0) of a C x R video wall, with one\n"
+            "                   process per cell on this machine; cell 0 sets the pace\n"
+            "  --wall-shm NAME  shared memory for the wall clock (default /dodeca-wall)\n"
+            "  --scene F        render the instances of binary scene F, reloading it when it changes\n"
+            "  --write-scene F N write a demo scene of N instances to F and exit\n"
+            "  --write-field F N write a chunked field of N instances to fly through and exit\n"
+            "  --test-scene     check that broken scene files are turned down and exit\n"
+            "  --scene-budget MB memory for the chunks of a chunked scene (default 64)\n"
+            "  --fly SPEED      move the camera forward through the scene at SPEED units/s\n"
+            "  --lod PX         draw instances under PX pixels across from pre-rendered sprites\n"
+            "  --lod-disc PX    and those under PX pixels as flat discs (default 4)\n"
+            "  --hiz            skip scene instances hidden behind the nearest ones (hierarchical Z)\n"
+            "  --shatter N      break the solid into N Voronoi shards that fly apart and back\n"
+            "  --bench-lod N    compare --lod with full traces of --scene over N frames and exit\n",
+            prog);
+}
+
+// Exactly six hex digits, followed by anything but another hex digit
+static int parseHexColor(const char *s, uint32_t *color) {
+    if (strspn(s, "0123456789abcdefABCDEF") != 6)
+        return -1;
+    *color = (uint32_t)strtoul(s, NULL, 16);
+    return 0;
+}
+
+// RRGGBB, gradient[:TOP:BOTTOM] or an image path, which must outlive bg.
+// bg is left alone on a malformed spec.
+static int parseBackground(const char *spec, Background *bg) {
+    Background parsed = *bg;
+    if (!strcmp(spec, "gradient")) {
+        parsed.kind = BG_GRADIENT;
+    } else if (!strncmp(spec, "gradient", 8)) {
+        if (spec[8] != ':' || parseHexColor(spec + 9, &parsed.top) < 0 || spec[15] != ':' ||
+            parseHexColor(spec + 16, &parsed.bottom) < 0 || spec[22] != '\0')
+            return -1;
+        parsed.kind = BG_GRADIENT;
+    } else if (spec[strspn(spec, "0123456789abcdefABCDEF")] == '\0') {
+        // all hex digits (or empty) can only mean a color
+        if (strlen(spec) != 6 || parseHexColor(spec, &parsed.color) < 0)
+            return -1;
+        parsed.kind = BG_SOLID;
+    } else {
+        parsed.kind = BG_IMAGE;
+        parsed.path = spec;
+    }
+    *bg = parsed;
+    return 0;
+}
+
+static int parseOptions(int argc, char *argv[], Options *opts) {
+    memset(opts, 0, sizeof(*opts));
+    opts->post.bloomThreshold = 0.7f;
+    opts->post.bloomStrength = 0.6f;
+    opts->roughness = -1;
+    opts->translucency.alpha = 0.5f;
+    opts->wallShm = "/dodeca-wall";
+    opts->sceneBudget = 64;
+    opts->lodDisc = 4;
+    opts->background.color = BG_COLOR;
+    opts->background.top = 0x3A5F8F;
+    opts->background.bottom = 0xC8D6E5;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--fovea") && i + 1 < argc) {
+            opts->fovea.innerRadius = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--fovea-outer") && i + 1 < argc) {
+            opts->fovea.outerRadius = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--threads") && i + 1 < argc) {
+            opts->threads = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--bloom")) {
+            opts->post.bloom = 1;
+            if (i + 1 < argc && argv[i + 1][0] != '-')
+                opts->post.bloomStrength = (float)atof(argv[++i]);
+        } else if (!strcmp(argv[i], "--bench-rays") && i + 1 < argc) {
+            opts->benchRays = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--bench-points") && i + 1 < argc) {
+            opts->benchPoints = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--voxelize") && i + 2 < argc) {
+            opts->voxelRes = atoi(argv[++i]);
+            opts->voxelPath = argv[++i];
+        } else if (!strcmp(argv[i], "--pathtrace")) {
+            opts->pathTrace = 1;
+            if (i + 1 < argc && argv[i + 1][0] != '-')
+                opts->pathTrace = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--progressive")) {
+            opts->progressive = 12;
+            if (i + 1 < argc && argv[i + 1][0] != '-')
+                opts->progressive = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--ibl")) {
+            opts->ibl = 1;
+            if (i + 1 < argc && argv[i + 1][0] != '-')
+                opts->envPath = argv[++i];
+        } else if (!strcmp(argv[i], "--background") && i + 1 < argc) {
+            if (parseBackground(argv[++i], &opts->background) < 0) {
+                fprintf(stderr, "Bad background %s, want RRGGBB, gradient[:TOP:BOTTOM] or a BMP path\n", argv[i]);
+                return -1;
+            }
+        } else if (!strcmp(argv[i], "--wall") && i + 1 < argc) {
+            int cols, rows, index;
+            if (sscanf(argv[++i], "%dx%d:%d", &cols, &rows, &index) != 3 || cols < 1 || rows < 1 ||
+                cols * rows > WALL_MAX_MEMBERS || index < 0 || index >= cols * rows) {
+                fprintf(stderr, "--wall wants COLSxROWS:INDEX with at most %d cells\n", WALL_MAX_MEMBERS);
+                return -1;
+            }
+            opts->wallCols = cols;
+            opts->wallRows = rows;
+            opts->wallIndex = index;
+        } else if (!strcmp(argv[i], "--wall-shm") && i + 1 < argc) {
+            opts->wallShm = argv[++i];
+        } else if (!strcmp(argv[i], "--scene") && i + 1 < argc) {
+            opts->scenePath = argv[++i];
+        } else if (!strcmp(argv[i], "--write-scene") && i + 2 < argc) {
+            opts->writeScenePath = argv[++i];
+            opts->writeSceneCount = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--write-field") && i + 2 < argc) {
+            opts->writeScenePath = argv[++i];
+            opts->writeSceneCount = atoi(argv[++i]);
+            opts->writeSceneField = 1;
+        } else if (!strcmp(argv[i], "--test-scene")) {
+            opts->testScene = 1;
+        } else if (!strcmp(argv[i], "--scene-budget") && i + 1 < argc) {
+            opts->sceneBudget = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--fly") && i + 1 < argc) {
+            opts->flySpeed = atof(argv[++i]);
+        } else if (!strcmp(argv[i], "--lod") && i + 1 < argc) {
+            opts->lodSprite = atof(argv[++i]);
+        } else if (!strcmp(argv[i], "--hiz")) {
+            opts->occlusion = 1;
+        } else if (!strcmp(argv[i], "--shatter") && i + 1 < argc) {
+            opts->shatter = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--lod-disc") && i + 1 < argc) {
+            opts->lodDisc = atof(argv[++i]);
+        } else if (!strcmp(argv[i], "--bench-lod") && i + 1 < argc) {
+            opts->benchLod = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--views") && i + 1 < argc) {
+            opts->views = argv[++i];
+        } else if (!strcmp(argv[i], "--stream") && i + 1 < argc) {
+            opts->streamPort = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--view") && i + 1 < argc) {
+            opts->viewAddr = argv[++i];
+        } else if (!strcmp(argv[i], "--metrics") && i + 1 < argc) {
+            opts->metricsPort = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--control") && i + 1 < argc) {
+            opts->controlPath = argv[++i];
+        } else if (!strcmp(argv[i], "--record") && i + 1 < argc) {
+            opts->recordPath = argv[++i];
+        } else if (!strcmp(argv[i], "--play") && i + 1 < argc) {
+            opts->playPath = argv[++i];
+        } else if (!strcmp(argv[i], "--bench-play") && i + 1 < argc) {
+            opts->benchPlay = argv[++i];
+        } else if (!strcmp(argv[i], "--aa")) {
+            opts->analyticAA = 1;
+        } else if (!strcmp(argv[i], "--bench-aa") && i + 1 < argc) {
+            opts->benchCoverage = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--xray")) {
+            opts->translucency.mode = TRANSLUCENT_XRAY;
+            if (i + 1 < argc && argv[i + 1][0] != '-')
+                opts->translucency.alpha = (float)atof(argv[++i]);
+        } else if (!strcmp(argv[i], "--absorb")) {
+            float density = 2.0f;
+            opts->translucency.mode = TRANSLUCENT_ABSORB;
+            if (i + 1 < argc && argv[i + 1][0] != '-')
+                density = (float)atof(argv[++i]);
+            opts->translucency.sigma[0] = density * 1.0f;
+            opts->translucency.sigma[1] = density * 0.45f;
+            opts->translucency.sigma[2] = density * 0.2f;
+        } else if (!strcmp(argv[i], "--specular") && i + 1 < argc) {
+            opts->roughness = (float)atof(argv[++i]);
+        } else if (!strcmp(argv[i], "--export-mesh") && i + 1 < argc) {
+            opts->meshPath = argv[++i];
+        } else if (!strcmp(argv[i], "--sdf")) {
+            opts->voxelSdf = 1;
+        } else if (!strcmp(argv[i], "--aov-dump") && i + 1 < argc) {
+            opts->aovDump = argv[++i];
+        } else if (!strcmp(argv[i], "--aov-shm") && i + 1 < argc) {
+            opts->aovShm = argv[++i];
+        } else if (!strcmp(argv[i], "--outline")) {
+            opts->post.outline = 1;
+        } else if (!strcmp(argv[i], "--lut") && i + 1 < argc) {
+            const char *lut = argv[++i];
+            if ((!strcmp(lut, "warm") ? buildWarmLut(&opts->post) : loadCubeLut(lut, &opts->post)) < 0)
+                return -1;
+        } else if (!strcmp(argv[i], "--help") || !strcmp(argv[i], "-h")) {
+            usage(argv[0]);
+            return 1;
+        } else {
+            fprintf(stderr, "Unknown option: %s\n", argv[i]);
+            usage(argv[0]);
+            return -1;
+        }
+    }
+    if (opts->views && (opts->pathTrace || opts->progressive || opts->post.bloom || opts->post.outline ||
+                        opts->post.lut || opts->aovDump || opts->aovShm || opts->recordPath || opts->streamPort)) {
+        fprintf(stderr, "--views works with plain, --aa, --ibl and translucent rendering only\n");
+        return -1;
+    }
+    if (opts->wallCols && opts->views) {
+        fprintf(stderr, "--wall and --views don't combine\n");
+        return -1;
+    }
+    if (opts->scenePath && opts->shatter > 0) {
+        fprintf(stderr, "--scene and --shatter don't combine\n");
+        return -1;
+    }
+    if ((opts->scenePath || opts->shatter > 0) &&
+        (opts->pathTrace || opts->progressive || opts->ibl || opts->translucency.mode || opts->analyticAA ||
+         opts->fovea.innerRadius > 0 || opts->aovDump || opts->aovShm || opts->recordPath || opts->streamPort ||
+         opts->views)) {
+        fprintf(stderr, "--scene and --shatter work with plain rendering, post effects and --wall only\n");
+        return -1;
+    }
+    if ((opts->lodSprite > 0 || opts->occlusion) && !opts->scenePath && opts->shatter <= 0) {
+        fprintf(stderr, "--lod and --hiz need a --scene or --shatter\n");
+        return -1;
+    }
+    if (opts->benchLod > 0 && !opts->scenePath) {
+        fprintf(stderr, "--bench-lod needs a --scene\n");
+        return -1;
+    }
+    if (opts->benchLod > 0 && opts->lodSprite <= 0)
+        opts->lodSprite = 16;
+    if (opts->fovea.innerRadius > 0 && opts->fovea.outerRadius < opts->fovea.innerRadius)
+        opts->fovea.outerRadius = opts->fovea.innerRadius * 2;
+    if (opts->threads <= 0)
+        opts->threads = SDL_GetCPUCount();
+    return 0;
+}
+
+// Recovers the polygon of face `index` by clipping a large square on its plane
+// against every other plane. Vertices come out counter-clockwise seen from
+// outside. Returns the vertex count, 0 if the plane does not touch the hull.
+int computeFacePolygon(const Plane *planes, int numPlanes, int index, Vec3 *out, int maxVertices) {
+    Vec3 buf[2][MAX_FACE_VERTICES];
+    Vec3 n = planes[index].n;
+    Vec3 helper = (fabs(n.x) < 0.9) ? (Vec3){1, 0, 0} : (Vec3){0, 1, 0};
+    Vec3 u = normalize(cross(helper, n));
+    Vec3 v = cross(n, u);
+    Vec3 c = scale(n, planes[index].d);
+    double r = 1e4;
+    buf[0][0] = add(c, add(scale(u, -r), scale(v, -r)));
+    buf[0][1] = add(c, add(scale(u, r), scale(v, -r)));
+    buf[0][2] = add(c, add(scale(u, r), scale(v, r)));
+    buf[0][3] = add(c, add(scale(u, -r), scale(v, r)));
+    int count = 4, cur = 0;
+    for (int j = 0; j < numPlanes && count > 0; j++) {
+        if (j == index)
+            continue;
+        const Plane *p = &planes[j];
+        Vec3 *in = buf[cur], *res = buf[cur ^ 1];
+        int outCount = 0;
+        for (int k = 0; k < count; k++) {
+            Vec3 a = in[k], b = in[(k + 1) % count];
+            double da = dot(p->n, a) - p->d, db = dot(p->n, b) - p->d;
+            if (da <= 0 && outCount < MAX_FACE_VERTICES)
+                res[outCount++] = a;
+            if ((da < 0 && db > 0) || (da > 0 && db < 0)) {
+                if (outCount < MAX_FACE_VERTICES)
+                    res[outCount++] = add(a, scale(subtract(b, a), da / (da - db)));
+            }
+        }
+        count = outCount;
+        cur ^= 1;
+    }
+    if (count < 3)
+        return 0;
+    if (count > maxVertices)
+        count = maxVertices;
+    memcpy(out, buf[cur], sizeof(Vec3) * count);
+    return count;
+}
+
+/*
+ * Mesh export. Faces are recovered one at a time and streamed out, so
+ * memory is bounded by the vertex hash. Shared corners are merged through a
+ * hash on coordinates quantized to MESH_WELD, probing the neighbouring cells
+ * so points that straddle a cell boundary still weld.
+ */
+#define MESH_WELD 1e-6
+
+typedef struct {
+    int64_t key[3];
+    Vec3 p;
+    int index; // -1 = empty slot
+} MeshVertexSlot;
+
+typedef struct {
+    MeshVertexSlot *slots;
+    size_t capacity, count;
+} MeshVertexHash;
+
+static uint64_t meshHashKey(int64_t x, int64_t y, int64_t z) {
+    uint64_t h = (uint64_t)x * 0x9E3779B97F4A7C15ull;
+    h ^= (uint64_t)y * 0xC2B2AE3D27D4EB4Full + (h << 6) + (h >> 2);
+    h ^= (uint64_t)z * 0x165667B19E3779F9ull + (h << 6) + (h >> 2);
+    return h;
+}
+
+static int meshHashInsert(MeshVertexHash *hash, const int64_t key[3], Vec3 p, int index) {
+    if ((hash->count + 1) * 2 > hash->capacity) {
+        size_t capacity = hash->capacity ? hash->capacity * 2 : 1024;
+        MeshVertexSlot *slots = malloc(sizeof(MeshVertexSlot) * capacity);
+        if (!slots)
+            return -1;
+        for (size_t i = 0; i < capacity; i++)
+            slots[i].index = -1;
+        for (size_t i = 0; i < hash->capacity; i++) {
+            if (hash->slots[i].index < 0)
+                continue;
+            size_t s = meshHashKey(hash->slots[i].key[0], hash->slots[i].key[1], hash->slots[i].key[2]) & (capacity - 1);
+            while (slots[s].index >= 0)
+                s = (s + 1) & (capacity - 1);
+            slots[s] = hash->slots[i];
+        }
+        free(hash->slots);
+        hash->slots = slots;
+        hash->capacity = capacity;
+    }
+    size_t s = meshHashKey(key[0], key[1], key[2]) & (hash->capacity - 1);
+    while (hash->slots[s].index >= 0)
+        s = (s + 1) & (hash->capacity - 1);
+    memcpy(hash->slots[s].key, key, sizeof(int64_t) * 3);
+    hash->slots[s].p = p;
+    hash->slots[s].index = index;
+    hash->count++;
+    return 0;
+}
+
+// Returns the index of an existing vertex within MESH_WELD of p, or -1
+static int meshHashFind(const MeshVertexHash *hash, const int64_t key[3], Vec3 p) {
+    if (!hash->capacity)
+        return -1;
+    for (int dz = -1; dz <= 1; dz++) {
+        for (int dy = -1; dy <= 1; dy++) {
+            for (int dx = -1; dx <= 1; dx++) {
+                int64_t k[3] = { key[0] + dx, key[1] + dy, key[2] + dz };
+                size_t s = meshHashKey(k[0], k[1], k[2]) & (hash->capacity - 1);
+                for (; hash->slots[s].index >= 0; s = (s + 1) & (hash->capacity - 1)) {
+                    const MeshVertexSlot *slot = &hash->slots[s];
+                    if (slot->key[0] == k[0] && slot->key[1] == k[1] && slot->key[2] == k[2] &&
+                        length(subtract(slot->p, p)) <= MESH_WELD)
+                        return slot->index;
+                }
+            }
+        }
+    }
+    return -1;
+}
+
+enum { MESH_STL, MESH_PLY, MESH_OBJ };
+
+typedef struct {
+    int format;
+    FILE *out;
+    FILE *faces;  // PLY faces are spooled here until the vertex count is known
+    long countOffset;
+    MeshVertexHash hash;
+    int numVertices;
+    uint32_t numTriangles;
+} MeshWriter;
+
+static void writeFloats(FILE *f, const float *v, int n) {
+    fwrite(v, sizeof(float), n, f);
+}
+
+static int meshVertex(MeshWriter *mw, Vec3 p) {
+    int64_t key[3] = { llround(p.x / MESH_WELD), llround(p.y / MESH_WELD), llround(p.z / MESH_WELD) };
+    int index = meshHashFind(&mw->hash, key, p);
+    if (index >= 0)
+        return index;
+    index = mw->numVertices++;
+    if (meshHashInsert(&mw->hash, key, p, index) < 0)
+        return -1;
+    if (mw->format == MESH_OBJ) {
+        fprintf(mw->out, "v %.9g %.9g %.9g\n", p.x, p.y, p.z);
+    } else {
+        float v[3] = { (float)p.x, (float)p.y, (float)p.z };
+        writeFloats(mw->out, v, 3);
+    }
+    return index;
+}
+
+static int meshFace(MeshWriter *mw, Vec3 normal, const Vec3 *poly, int count) {
+    if (mw->format == MESH_STL) {
+        for (int k = 1; k + 1 < count; k++) {
+            float tri[12] = {
+                (float)normal.x, (float)normal.y, (float)normal.z,
+                (float)poly[0].x, (float)poly[0].y, (float)poly[0].z,
+                (float)poly[k].x, (float)poly[k].y, (float)poly[k].z,
+                (float)poly[k + 1].x, (float)poly[k + 1].y, (float)poly[k + 1].z
+            };
+            uint16_t attr = 0;
+            writeFloats(mw->out, tri, 12);
+            fwrite(&attr, sizeof(attr), 1, mw->out);
+            mw->numTriangles++;
+        }
+        return 0;
+    }
+    int idx[MAX_FACE_VERTICES];
+    for (int k = 0; k < count; k++) {
+        idx[k] = meshVertex(mw, poly[k]);
+        if (idx[k] < 0)
+            return -1;
+    }
+    for (int k = 1; k + 1 < count; k++) {
+        if (idx[0] == idx[k] || idx[k] == idx[k + 1] || idx[0] == idx[k + 1])
+            continue; // sliver collapsed by welding
+        if (mw->format == MESH_OBJ) {
+            fprintf(mw->out, "f %d %d %d\n", idx[0] + 1, idx[k] + 1, idx[k + 1] + 1);
+        } else {
+            uint8_t n = 3;
+            int32_t tri[3] = { idx[0], idx[k], idx[k + 1] };
+            fwrite(&n, 1, 1, mw->faces);
+            fwrite(tri, sizeof(int32_t), 3, mw->faces);
+        }
+        mw->numTriangles++;
+    }
+    return 0;
+}
+
+// Triangulates every face of the plane set into an STL, PLY or OBJ file,
+// picked by the extension of path
+int exportMesh(const Plane *planes, int numPlanes, const char *path) {
+    MeshWriter mw;
+    memset(&mw, 0, sizeof(mw));
+    const char *ext = strrchr(path, '.');
+    if (ext && !strcmp(ext, ".stl")) {
+        mw.format = MESH_STL;
+    } else if (ext && !strcmp(ext, ".ply")) {
+        mw.format = MESH_PLY;
+    } else if (ext && !strcmp(ext, ".obj")) {
+        mw.format = MESH_OBJ;
+    } else {
+        fprintf(stderr, "Unknown mesh format for %s (use .stl, .ply or .obj)\n", path);
+        return 1;
+    }
+    mw.out = fopen(path, mw.format == MESH_OBJ ? "w" : "wb");
+    if (!mw.out) {
+        perror(path);
+        return 1;
+    }
+    if (mw.format == MESH_STL) {
+        char header[80] = "Dodecahedron.c plane set";
+        uint32_t zero = 0;
+        fwrite(header, 1, sizeof(header), mw.out);
+        mw.countOffset = ftell(mw.out);
+        fwrite(&zero, sizeof(zero), 1, mw.out);
+    } else if (mw.format == MESH_PLY) {
+        mw.faces = tmpfile();
+        if (!mw.faces) {
+            perror("tmpfile");
+            fclose(mw.out);
+            return 1;
+        }
+        fprintf(mw.out, "ply\nformat binary_little_endian 1.0\ncomment Dodecahedron.c plane set\n");
+        mw.countOffset = ftell(mw.out);
+        fprintf(mw.out, "element vertex %010d\nproperty float x\nproperty float y\nproperty float z\n"
+                        "element face %010d\nproperty list uchar int vertex_indices\nend_header\n", 0, 0);
+    } else {
+        fprintf(mw.out, "# Dodecahedron.c plane set\n");
+    }
+
+    int rc = 0, faces = 0;
+    for (int i = 0; i < numPlanes && rc == 0; i++) {
+        Vec3 poly[MAX_FACE_VERTICES];
+        int count = computeFacePolygon(planes, numPlanes, i, poly, MAX_FACE_VERTICES);
+        if (count < 3)
+            continue;
+        rc = meshFace(&mw, planes[i].n, poly, count);
+        faces++;
+    }
+
+    if (rc == 0 && mw.format == MESH_STL) {
+        fseek(mw.out, mw.countOffset, SEEK_SET);
+        fwrite(&mw.numTriangles, sizeof(mw.numTriangles), 1, mw.out);
+    } else if (rc == 0 && mw.format == MESH_PLY) {
+        char buf[65536];
+        size_t n;
+        rewind(mw.faces);
+        while ((n = fread(buf, 1, sizeof(buf), mw.faces)) > 0)
+            fwrite(buf, 1, n, mw.out);
+        fseek(mw.out, mw.countOffset, SEEK_SET);
+        fprintf(mw.out, "element vertex %010d\nproperty float x\nproperty float y\nproperty float z\n"
+                        "element face %010u\n", mw.numVertices, mw.numTriangles);
+    }
+    if (mw.faces)
+        fclose(mw.faces);
+    if (fclose(mw.out) != 0 || rc != 0) {
+        fprintf(stderr, "Failed to write %s\n", path);
+        free(mw.hash.slots);
+        return 1;
+    }
+    printf("Exported %d faces, %d vertices, %u triangles to %s\n", faces,
+           mw.format == MESH_STL ? 3 * (int)mw.numTriangles : mw.numVertices, mw.numTriangles, path);
+    free(mw.hash.slots);
+    return 0;
+}
+
+/*
+ * Voronoi fracture (--shatter N). Each of N seeds inside the solid owns the
+ * points nearer to it than to any other seed, and that cell clipped to the
+ * solid is the solid's planes plus the bisectors against the other seeds:
+ * a convex plane set the scene renderer traces like any other instance.
+ * Bisectors go in nearest seed first and only while they can still cut
+ * (half the distance to the seed is within the cell's farthest vertex);
+ * planes that stop touching the cell are dropped using computeFacePolygon.
+ * Shards are cut one job each on the pool into an in-memory scene, and
+ * flown apart and back together by rewriting their instances every frame.
+ */
+#define SHATTER_INTACT_MS 1500
+#define SHATTER_FLIGHT_MS 2500 // out, then the same way back
+#define SHATTER_SPEED 0.35     // units per second at the rim, less further in
+
+typedef struct {
+    Vec3 centroid;  // in the solid's frame; the shard's planes are about it
+    Vec3 velocity;
+    double tumble;  // extra rotation per second of flight
+} Shard;
+
+typedef struct {
+    SceneInstance *instances; // writable, inside the scene's mapping
+    Shard *shards;
+    int count;
+    double planesPerShard;
+} Fracture;
+
+typedef struct {
+    const Plane *solid;
+    int numSolid;
+    double extent; // of the solid, from its center
+    const Vec3 *seeds;
+    int count;
+    Plane (*planes)[MAX_PLANES];
+    int *numPlanes;
+    double *radius;
+    Shard *shards;
+} FractureJobs;
+
+typedef struct {
+    double dist;
+    int index;
+} SeedDistance;
+
+static int compareSeedDistance(const void *a, const void *b) {
+    double da = ((const SeedDistance *)a)->dist, db = ((const SeedDistance *)b)->dist;
+    return (da > db) - (da < db);
+}
+
+// Drops the planes that don't bound the cell, then returns the distance of
+// its farthest vertex from `from`, and the vertex average in centroid
+static double cellPrune(Plane *planes, int *numPlanes, Vec3 from, Vec3 *centroid) {
+    Vec3 poly[MAX_FACE_VERTICES];
+    int keep[MAX_PLANES + 1], kept = 0, vertices = 0; // one spare for a new cut
+    double extent = 0;
+    *centroid = (Vec3){ 0, 0, 0 };
+    for (int p = 0; p < *numPlanes; p++) {
+        int n = computeFacePolygon(planes, *numPlanes, p, poly, MAX_FACE_VERTICES);
+        keep[p] = n >= 3;
+        for (int v = 0; v < n && keep[p]; v++) {
+            extent = fmax(extent, length(subtract(poly[v], from)));
+            *centroid = add(*centroid, poly[v]);
+            vertices++;
+        }
+    }
+    for (int p = 0; p < *numPlanes; p++) {
+        if (keep[p])
+            planes[kept++] = planes[p];
+    }
+    *numPlanes = kept;
+    if (vertices)
+        *centroid = scale(*centroid, 1.0 / vertices);
+    return extent;
+}
+
+static void fractureJob(void *arg, int index) {
+    const FractureJobs *jobs = arg;
+    Plane *planes = jobs->planes[index];
+    Plane cell[MAX_PLANES + 1]; // room for a cut before pruning
+    Vec3 seed = jobs->seeds[index], centroid, unused;
+    int n = jobs->numSolid;
+    memcpy(cell, jobs->solid, sizeof(Plane) * n);
+    SeedDistance *order = malloc(sizeof(SeedDistance) * jobs->count);
+    if (!order) {
+        jobs->numPlanes[index] = 0;
+        return;
+    }
+    for (int i = 0; i < jobs->count; i++)
+        order[i] = (SeedDistance){ length(subtract(jobs->seeds[i], seed)), i };
+    qsort(order, jobs->count, sizeof(SeedDistance), compareSeedDistance);
+    double extent = cellPrune(cell, &n, seed, &centroid);
+    for (int k = 0; k < jobs->count; k++) {
+        if (order[k].index == index || order[k].dist == 0)
+            continue;
+        if (order[k].dist / 2 >= extent)
+            break;
+        Vec3 dir = scale(subtract(jobs->seeds[order[k].index], seed), 1 / order[k].dist);
+        cell[n].n = dir;
+        cell[n++].d = dot(dir, seed) + order[k].dist / 2;
+        extent = cellPrune(cell, &n, seed, &centroid);
+        if (n > MAX_PLANES) {
+            // stopping here would leave the shard too big, overlapping
+            // its neighbours, so fractureBuild gives up instead
+            free(order);
+            jobs->numPlanes[index] = -1;
+            return;
+        }
+    }
+    free(order);
+    memcpy(planes, cell, sizeof(Plane) * n);
+    // about the centroid, so the shard spins in place
+    for (int p = 0; p < n; p++)
+        planes[p].d -= dot(planes[p].n, centroid);
+    jobs->numPlanes[index] = n;
+    jobs->radius[index] = cellPrune(planes, &n, (Vec3){ 0, 0, 0 }, &unused);
+    // outwards, faster the further out, with some scatter
+    Shard *sh = &jobs->shards[index];
+    uint32_t h = hash32(index * 4 + 1);
+    Vec3 jitter = { (h & 0xFF) / 255.0 - 0.5, (h >> 8 & 0xFF) / 255.0 - 0.5, (h >> 16 & 0xFF) / 255.0 - 0.5 };
+    sh->centroid = centroid;
+    sh->velocity = scale(add(scale(centroid, 1 / jobs->extent), scale(jitter, 0.3)), SHATTER_SPEED);
+    sh->tumble = ((h >> 24) / 255.0 - 0.5) * 6;
+}
+
+// Cuts the solid into count shards and puts them in sc as an anonymous
+// mapping laid out like a scene file, so they go through sceneAttach.
+static int fractureBuild(WorkerPool *pool, Scene *sc, Fracture *fr, const Plane *solid, int numSolid, int count) {
+    memset(fr, 0, sizeof(*fr));
+    memset(sc, 0, sizeof(*sc));
+    sc->fd = -1;
+    Vec3 centroid;
+    Plane hull[MAX_PLANES];
+    int numHull = numSolid;
+    memcpy(hull, solid, sizeof(Plane) * numSolid);
+    double extent = cellPrune(hull, &numHull, (Vec3){ 0, 0, 0 }, &centroid);
+
+    Vec3 *seeds = malloc(sizeof(Vec3) * count);
+    Plane (*planes)[MAX_PLANES] = malloc(sizeof(Plane) * MAX_PLANES * count);
+    int *numPlanes = malloc(sizeof(int) * count);
+    double *radius = malloc(sizeof(double) * count);
+    fr->shards = malloc(sizeof(Shard) * count);
+    if (!seeds || !planes || !numPlanes || !radius || !fr->shards) {
+        fprintf(stderr, "Out of memory for %d shards\n", count);
+        free(seeds);
+        free(planes);
+        free(numPlanes);
+        free(radius);
+        free(fr->shards);
+        return -1;
+    }
+    // seeds uniform in the solid, by rejection from its bounding cube
+    uint32_t draw = 0;
+    for (int i = 0; i < count; draw++) {
+        Vec3 p = { hash32(draw * 3) / 2147483648.0 - 1, hash32(draw * 3 + 1) / 2147483648.0 - 1,
+                   hash32(draw * 3 + 2) / 2147483648.0 - 1 };
+        p = scale(p, extent);
+        int inside = 1;
+        for (int k = 0; k < numHull && inside; k++)
+            inside = dot(hull[k].n, p) < hull[k].d;
+        if (inside)
+            seeds[i++] = p;
+    }
+    FractureJobs jobs = { hull, numHull, extent, seeds, count, planes, numPlanes, radius, fr->shards };
+    poolRun(pool, fractureJob, &jobs, count);
+
+    uint32_t total = 0;
+    for (int i = 0; i < count; i++) {
+        if (numPlanes[i] < 0) {
+            fprintf(stderr, "Failed to shatter the solid: shard %d needs more than %d planes\n", i, MAX_PLANES);
+            free(seeds);
+            free(planes);
+            free(numPlanes);
+            free(radius);
+            free(fr->shards);
+            fr->shards = NULL;
+            return -1;
+        }
+        total += numPlanes[i];
+    }
+    SceneHeader h;
+    memset(&h, 0, sizeof(h));
+    h.magic = SCENE_MAGIC;
+    h.version = SCENE_VERSION;
+    h.numPlaneSets = count;
+    h.numPlanes = total;
+    h.numMaterials = 1;
+    h.numInstances = count;
+    h.planeSetOffset = sizeof(h);
+    h.planeOffset = h.planeSetOffset + sizeof(ScenePlaneSet) * count;
+    h.materialOffset = h.planeOffset + sizeof(Plane) * total;
+    h.lightOffset = h.materialOffset + sizeof(SceneMaterial);
+    h.instanceOffset = h.lightOffset;
+    sc->size = h.instanceOffset + sizeof(SceneInstance) * count;
+    sc->map = mmap(NULL, sc->size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    const char *err = NULL;
+    if (sc->map == MAP_FAILED) {
+        sc->map = NULL;
+        err = "out of memory";
+    } else {
+        uint8_t *base = sc->map;
+        memcpy(base, &h, sizeof(h));
+        ScenePlaneSet *sets = (ScenePlaneSet *)(base + h.planeSetOffset);
+        Plane *out = (Plane *)(base + h.planeOffset);
+        SceneMaterial *material = (SceneMaterial *)(base + h.materialOffset);
+        fr->instances = (SceneInstance *)(base + h.instanceOffset);
+        // white and unlit but for the directional light, as shade() does it
+        *material = (SceneMaterial){ 0xFFFFFF, 0 };
+        uint32_t first = 0;
+        for (int i = 0; i < count; i++) {
+            sets[i] = (ScenePlaneSet){ first, (uint32_t)numPlanes[i], radius[i] };
+            memcpy(out + first, planes[i], sizeof(Plane) * numPlanes[i]);
+            first += numPlanes[i];
+            fr->instances[i] = (SceneInstance){ fr->shards[i].centroid, 1, 1, 0, (uint32_t)i, 0 };
+        }
+        err = sceneAttach(sc);
+    }
+    free(seeds);
+    free(planes);
+    free(numPlanes);
+    free(radius);
+    if (err) {
+        fprintf(stderr, "Failed to shatter the solid: %s\n", err);
+        sceneClose(sc);
+        free(fr->shards);
+        fr->shards = NULL;
+        return -1;
+    }
+    fr->count = count;
+    fr->planesPerShard = (double)total / count;
+    return 0;
+}
+
+// Places and turns the shards for this frame: together for
+// SHATTER_INTACT_MS, then out along their velocities and back the same way.
+// At rest they are the solid rotated to angle, so the cut doesn't show.
+static void fractureAnimate(Fracture *fr, double angle, Uint32 ms) {
+    Uint32 t = ms % (SHATTER_INTACT_MS + 2 * SHATTER_FLIGHT_MS);
+    double flight = 0;
+    if (t > SHATTER_INTACT_MS) {
+        t -= SHATTER_INTACT_MS;
+        flight = (t < SHATTER_FLIGHT_MS ? t : 2 * SHATTER_FLIGHT_MS - t) / 1000.0;
+    }
+    for (int i = 0; i < fr->count; i++) {
+        const Shard *sh = &fr->shards[i];
+        fr->instances[i].position = rotate(add(sh->centroid, scale(sh->velocity, flight)), angle);
+        fr->instances[i].phase = sh->tumble * flight;
+    }
+}
+
+/*
+ * Exact coverage anti-aliasing. The front faces of a convex solid tile its
+ * silhouette without overlapping, so an edge pixel's color is the sum of
+ * each projected face clipped to the pixel square, weighted by area, with
+ * the uncovered rest taken from the background. Pixel x covers
+ * [x - 0.5, x + 0.5] since rays go through integer coordinates. Only the
+ * pixels an edge crosses are found (grid walk) and resolved; every other
+ * pixel already has the right color from the traced pass.
+ */
+#define COVERAGE_JOB_SIZE 256
+
+typedef struct {
+    int face;
+    int count;
+    double x[MAX_FACE_VERTICES], y[MAX_FACE_VERTICES];
+    double minX, minY, maxX, maxY;
+} ScreenPolygon;
+
+typedef struct {
+    const RenderContext *ctx;
+    ScreenPolygon poly[MAX_PLANES];
+    int numPolys;
+    uint8_t *mark;      // frame-sized, set while a pixel is on the edge list
+    int32_t *edgePixels;
+    int numEdgePixels, capacity;
+} Coverage;
+
+static int coverageInit(Coverage *cov, int width, int height) {
+    memset(cov, 0, sizeof(*cov));
+    cov->mark = calloc((size_t)width * height, 1);
+    cov->capacity = 4096;
+    cov->edgePixels = malloc(sizeof(int32_t) * cov->capacity);
+    return (cov->mark && cov->edgePixels) ? 0 : -1;
+}
+
+static void coverageFree(Coverage *cov) {
+    free(cov->mark);
+    free(cov->edgePixels);
+}
+
+// Projects the faces turned towards the camera. Fails if any vertex is at
+// or behind the eye plane, where the projection stops being a polygon.
+static int projectFaces(Coverage *cov, const RenderContext *ctx) {
+    double focal = 5 * ctx->scaleFactor;
+    cov->numPolys = 0;
+    for (int i = 0; i < ctx->numPlanes; i++) {
+        const Plane *p = &ctx->planes[i];
+        if (dot(p->n, ctx->camPos) - p->d <= 0)
+            continue;
+        Vec3 verts[MAX_FACE_VERTICES];
+        int count = computeFacePolygon(ctx->planes, ctx->numPlanes, i, verts, MAX_FACE_VERTICES);
+        if (count == 0)
+            continue;
+        ScreenPolygon *sp = &cov->poly[cov->numPolys++];
+        sp->face = i;
+        sp->count = count;
+        sp->minX = sp->minY = 1e30;
+        sp->maxX = sp->maxY = -1e30;
+        for (int k = 0; k < count; k++) {
+            Vec3 rel = subtract(verts[k], ctx->camPos);
+            double depth = dot(rel, ctx->camForward);
+            if (depth < 1e-6)
+                return -1;
+            sp->x[k] = ctx->halfWidth + focal * dot(rel, ctx->camRight) / depth;
+            sp->y[k] = ctx->halfHeight - focal * dot(rel, ctx->camUp) / depth;
+            sp->minX = fmin(sp->minX, sp->x[k]);
+            sp->maxX = fmax(sp->maxX, sp->x[k]);
+            sp->minY = fmin(sp->minY, sp->y[k]);
+            sp->maxY = fmax(sp->maxY, sp->y[k]);
+        }
+    }
+    return 0;
+}
+
+static int pushEdgePixel(Coverage *cov, int pixel) {
+    if (cov->mark[pixel])
+        return 0;
+    if (cov->numEdgePixels == cov->capacity) {
+        int32_t *grown = realloc(cov->edgePixels, sizeof(int32_t) * cov->capacity * 2);
+        if (!grown)
+            return -1;
+        cov->edgePixels = grown;
+        cov->capacity *= 2;
+    }
+    cov->mark[pixel] = 1;
+    cov->edgePixels[cov->numEdgePixels++] = pixel;
+    return 0;
+}
+
+// Queues every pixel the segment passes through (Amanatides-Woo walk over
+// the pixel grid), after clipping it to the frame
+static int walkEdge(Coverage *cov, double x0, double y0, double x1, double y1) {
+    const Frame *frame = cov->ctx->frame;
+    double dx = x1 - x0, dy = y1 - y0, t0 = 0, t1 = 1;
+    double lo[2] = { -0.5, -0.5 }, hi[2] = { frame->width - 0.5, frame->height - 0.5 };
+    double p[2] = { x0, y0 }, d[2] = { dx, dy };
+    for (int a = 0; a < 2; a++) {
+        if (d[a] == 0) {
+            if (p[a] < lo[a] || p[a] > hi[a])
+                return 0;
+            continue;
+        }
+        double ta = (lo[a] - p[a]) / d[a], tb = (hi[a] - p[a]) / d[a];
+        t0 = fmax(t0, fmin(ta, tb));
+        t1 = fmin(t1, fmax(ta, tb));
+    }
+    if (t0 > t1)
+        return 0;
+    double sx = x0 + dx * t0, sy = y0 + dy * t0;
+    int cx = (int)floor(sx + 0.5), cy = (int)floor(sy + 0.5);
+    int ex = (int)floor(x0 + dx * t1 + 0.5), ey = (int)floor(y0 + dy * t1 + 0.5);
+    cx = cx < 0 ? 0 : cx >= frame->width ? frame->width - 1 : cx;
+    cy = cy < 0 ? 0 : cy >= frame->height ? frame->height - 1 : cy;
+    ex = ex < 0 ? 0 : ex >= frame->width ? frame->width - 1 : ex;
+    ey = ey < 0 ? 0 : ey >= frame->height ? frame->height - 1 : ey;
+    int stepX = dx > 0 ? 1 : -1, stepY = dy > 0 ? 1 : -1;
+    double tMaxX = dx != 0 ? (cx + 0.5 * stepX - sx) / dx : 1e30;
+    double tMaxY = dy != 0 ? (cy + 0.5 * stepY - sy) / dy : 1e30;
+    double tDeltaX = dx != 0 ? stepX / dx : 1e30, tDeltaY = dy != 0 ? stepY / dy : 1e30;
+    // a fixed step count keeps rounding at the ends from running off
+    for (int n = abs(ex - cx) + abs(ey - cy); ; n--) {
+        if (pushEdgePixel(cov, cy * frame->width + cx) < 0)
+            return -1;
+        if (n == 0)
+            break;
+        if ((tMaxX < tMaxY && cx != ex) || cy == ey) {
+            cx += stepX;
+            tMaxX += tDeltaX;
+        } else {
+            cy += stepY;
+            tMaxY += tDeltaY;
+        }
+    }
+    return 0;
+}
+
+// Area of the polygon clipped to the square [x0, x1] x [y0, y1]
+static double clippedArea(const ScreenPolygon *sp, double x0, double y0, double x1, double y1) {
+    double buf[2][2][MAX_FACE_VERTICES + 4];
+    int count = sp->count, cur = 0;
+    memcpy(buf[0][0], sp->x, sizeof(double) * count);
+    memcpy(buf[0][1], sp->y, sizeof(double) * count);
+    for (int side = 0; side < 4 && count > 0; side++) {
+        int axis = side & 1;
+        double bound = (side == 0) ? x0 : (side == 1) ? y0 : (side == 2) ? x1 : y1;
+        double sign = side < 2 ? 1 : -1; // keep sign * (v - bound) >= 0
+        double *ix = buf[cur][0], *iy = buf[cur][1], *ox = buf[cur ^ 1][0], *oy = buf[cur ^ 1][1];
+        int outCount = 0;
+        for (int k = 0; k < count; k++) {
+            int j = (k + 1 == count) ? 0 : k + 1;
+            double da = sign * ((axis ? iy[k] : ix[k]) - bound);
+            double db = sign * ((axis ? iy[j] : ix[j]) - bound);
+            if (da >= 0) {
+                ox[outCount] = ix[k];
+                oy[outCount++] = iy[k];
+            }
+            if ((da >= 0) != (db >= 0)) {
+                double t = da / (da - db);
+                ox[outCount] = ix[k] + (ix[j] - ix[k]) * t;
+                oy[outCount++] = iy[k] + (iy[j] - iy[k]) * t;
+            }
+        }
+        count = outCount;
+        cur ^= 1;
+    }
+    double area = 0;
+    for (int k = 0; k < count; k++) {
+        int j = (k + 1 == count) ? 0 : k + 1;
+        area += buf[cur][0][k] * buf[cur][1][j] - buf[cur][0][j] * buf[cur][1][k];
+    }
+    return fabs(area) * 0.5;
+}
+
+static void coverageJob(void *arg, int index) {
+    const Coverage *cov = arg;
+    const RenderContext *ctx = cov->ctx;
+    int width = ctx->frame->width;
+    int end = (index + 1) * COVERAGE_JOB_SIZE;
+    if (end > cov->numEdgePixels)
+        end = cov->numEdgePixels;
+    for (int e = index * COVERAGE_JOB_SIZE; e < end; e++) {
+        int pixel = cov->edgePixels[e];
+        double x0 = pixel % width - 0.5, y0 = pixel / width - 0.5;
+        double rgb[3] = { 0, 0, 0 }, covered = 0;
+        for (int i = 0; i < cov->numPolys; i++) {
+            const ScreenPolygon *sp = &cov->poly[i];
+            if (sp->maxX <= x0 || sp->minX >= x0 + 1 || sp->maxY <= y0 || sp->minY >= y0 + 1)
+                continue;
+            double a = clippedArea(sp, x0, y0, x0 + 1, y0 + 1);
+            uint32_t c = ctx->faceColor[sp->face];
+            rgb[0] += a * ((c >> 16) & 0xFF);
+            rgb[1] += a * ((c >> 8) & 0xFF);
+            rgb[2] += a * (c & 0xFF);
+            covered += a;
+        }
+        double rest = covered < 1 ? 1 - covered : 0;
+        uint32_t bg = ctx->background[pixel], out = 0;
+        for (int ch = 0; ch < 3; ch++) {
+            double v = rgb[ch] + rest * ((bg >> (16 - 8 * ch)) & 0xFF);
+            out |= (uint32_t)(v > 255 ? 255 : v + 0.5) << (16 - 8 * ch);
+        }
+        ctx->frame->pixels[pixel] = out;
+    }
+}
+
+// Replaces the traced color of every pixel an edge crosses with its exact
+// coverage blend. Returns the number of edge pixels, or -1 if the view
+// could not be projected (camera inside or too close) and was left alone.
+static int coverageResolve(WorkerPool *pool, Coverage *cov, const RenderContext *ctx) {
+    cov->ctx = ctx;
+    for (int e = 0; e < cov->numEdgePixels; e++)
+        cov->mark[cov->edgePixels[e]] = 0;
+    cov->numEdgePixels = 0;
+    if (projectFaces(cov, ctx) < 0)
+        return -1;
+    for (int i = 0; i < cov->numPolys; i++) {
+        const ScreenPolygon *sp = &cov->poly[i];
+        for (int k = 0; k < sp->count; k++) {
+            int j = (k + 1 == sp->count) ? 0 : k + 1;
+            if (walkEdge(cov, sp->x[k], sp->y[k], sp->x[j], sp->y[j]) < 0)
+                return -1;
+        }
+    }
+    poolRun(pool, coverageJob, cov, (cov->numEdgePixels + COVERAGE_JOB_SIZE - 1) / COVERAGE_JOB_SIZE);
+    return cov->numEdgePixels;
+}
+
+// Box-filtered reference for the benchmark: n x n stratified rays per pixel
+typedef struct {
+    const RenderContext *ctx;
+    const int32_t *pixelList; // NULL = the whole frame, one row per job
+    int count;
+    int grid;
+    uint32_t *out;
+} SupersampleJobs;
+
+static uint32_t supersamplePixel(const RenderContext *ctx, int x, int y, int grid) {
+    double sum[3] = { 0, 0, 0 };
+    int pixel = y * ctx->frame->width + x;
+    for (int sy = 0; sy < grid; sy++) {
+        for (int sx = 0; sx < grid; sx++) {
+            Vec3 dir = pixelRay(ctx, x - 0.5 + (sx + 0.5) / grid, y - 0.5 + (sy + 0.5) / grid);
+            uint32_t c = sampleColor(ctx, traceRay(ctx->planes, ctx->numPlanes, ctx->camPos, dir, NULL, NULL), pixel);
+            sum[0] += (c >> 16) & 0xFF;
+            sum[1] += (c >> 8) & 0xFF;
+            sum[2] += c & 0xFF;
+        }
+    }
+    double inv = 1.0 / (grid * grid);
+    return (uint32_t)(sum[0] * inv + 0.5) << 16 | (uint32_t)(sum[1] * inv + 0.5) << 8 | (uint32_t)(sum[2] * inv + 0.5);
+}
+
+static void supersampleJob(void *arg, int index) {
+    const SupersampleJobs *jobs = arg;
+    int width = jobs->ctx->frame->width;
+    if (!jobs->pixelList) {
+        for (int x = 0; x < width; x++)
+            jobs->out[index * width + x] = supersamplePixel(jobs->ctx, x, index, jobs->grid);
+        return;
+    }
+    int end = (index + 1) * COVERAGE_JOB_SIZE < jobs->count ? (index + 1) * COVERAGE_JOB_SIZE : jobs->count;
+    for (int e = index * COVERAGE_JOB_SIZE; e < end; e++) {
+        int pixel = jobs->pixelList[e];
+        jobs->out[e] = supersamplePixel(jobs->ctx, pixel % width, pixel / width, jobs->grid);
+    }
+}
+
+static double colorError(uint32_t a, uint32_t b) {
+    double err = 0;
+    for (int shift = 16; shift >= 0; shift -= 8)
+        err += fabs((double)((a >> shift) & 0xFF) - ((b >> shift) & 0xFF));
+    return err / 3;
+}
+
+// Analytic coverage against 4x4 supersampling: time per frame, and mean/max
+// error on the edge pixels against a 64x64 box-filtered reference. All
+// other pixels are a single face or background under both methods.
+static int benchCoverage(const Plane *basePlanes, int numPlanes, int frames, int threads) {
+    int width = WINDOW_WIDTH, height = WINDOW_HEIGHT;
+    uint32_t *pixels = malloc(sizeof(uint32_t) * width * height);
+    uint32_t *super = malloc(sizeof(uint32_t) * width * height);
+    uint8_t *faceIds = malloc((size_t)width * height);
+    Background bg = { BG_SOLID, BG_COLOR, 0, 0, NULL, 0, 0, NULL, 0 };
+    Coverage cov;
+    WorkerPool pool;
+    if (!pixels || !super || !faceIds || ensureBackground(&bg, width, height) < 0 ||
+        coverageInit(&cov, width, height) < 0 || poolInit(&pool, threads) < 0) {
+        fprintf(stderr, "Failed to set up the coverage benchmark\n");
+        return 1;
+    }
+    Frame frame = { width, height, pixels, faceIds, 0, 0 };
+    Plane planes[MAX_PLANES];
+    RenderContext ctx;
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.planes = planes;
+    ctx.numPlanes = numPlanes;
+    setCamera(&ctx, (Vec3){ 0, 0, -5 }, (Vec3){ 0, 0, 0 }, (Vec3){ 0, 1, 0 });
+    ctx.scaleFactor = 300.0;
+    ctx.halfWidth = width / 2.0;
+    ctx.halfHeight = height / 2.0;
+    ctx.frame = &frame;
+    ctx.background = bg.pixels;
+    Vec3 lightDir = normalize((Vec3){ 1, 1, -1 });
+
+    double freq = (double)SDL_GetPerformanceFrequency();
+    double analyticSec = 0, resolveSec = 0, superSec = 0, analyticErr = 0, superErr = 0, analyticMax = 0, superMax = 0;
+    long edgeTotal = 0;
+    int checked = 0;
+    for (int f = 0; f < frames; f++) {
+        double angle = f * 0.37;
+        for (int i = 0; i < numPlanes; i++) {
+            planes[i].n = rotate(basePlanes[i].n, angle);
+            planes[i].d = basePlanes[i].d;
+        }
+        ctx.angle = angle;
+        buildFaceColors(planes, numPlanes, lightDir, ctx.faceColor);
+
+        Uint64 start = SDL_GetPerformanceCounter();
+        renderFrame(&pool, &ctx, NULL);
+        Uint64 traced = SDL_GetPerformanceCounter();
+        int edges = coverageResolve(&pool, &cov, &ctx);
+        analyticSec += (SDL_GetPerformanceCounter() - start) / freq;
+        resolveSec += (SDL_GetPerformanceCounter() - traced) / freq;
+        edgeTotal += edges > 0 ? edges : 0;
+
+        SupersampleJobs jobs = { &ctx, NULL, 0, 4, super };
+        start = SDL_GetPerformanceCounter();
+        poolRun(&pool, supersampleJob, &jobs, height);
+        superSec += (SDL_GetPerformanceCounter() - start) / freq;
+
+        // the reference only needs the edge pixels, and is too slow to run on every frame
+        if (edges <= 0 || f % 4 != 0)
+            continue;
+        uint32_t *ref = malloc(sizeof(uint32_t) * edges);
+        if (!ref)
+            break;
+        SupersampleJobs refJobs = { &ctx, cov.edgePixels, edges, 64, ref };
+        poolRun(&pool, supersampleJob, &refJobs, (edges + COVERAGE_JOB_SIZE - 1) / COVERAGE_JOB_SIZE);
+        for (int e = 0; e < edges; e++) {
+            int pixel = cov.edgePixels[e];
+            double ea = colorError(pixels[pixel], ref[e]), es = colorError(super[pixel], ref[e]);
+            analyticErr += ea;
+            superErr += es;
+            analyticMax = fmax(analyticMax, ea);
+            superMax = fmax(superMax, es);
+        }
+        checked += edges;
+        free(ref);
+    }
+    printf("Frames: %d, %dx%d, %.0f edge pixels per frame (%.2f%%)\n", frames, width, height,
+           (double)edgeTotal / frames, 100.0 * edgeTotal / frames / (width * height));
+    printf("  analytic coverage: %7.2f ms/frame, edge error vs 64x64 mean %.3f max %.2f levels\n",
+           analyticSec * 1000 / frames, checked ? analyticErr / checked : 0, analyticMax);
+    printf("    of which coverage: %5.2f ms/frame, %.0f ns per edge pixel\n", resolveSec * 1000 / frames,
+           edgeTotal ? resolveSec * 1e9 / edgeTotal : 0);
+    printf("  16x supersampling: %7.2f ms/frame, edge error vs 64x64 mean %.3f max %.2f levels\n",
+           superSec * 1000 / frames, checked ? superErr / checked : 0, superMax);
+    poolDestroy(&pool);
+    coverageFree(&cov);
+    free(bg.pixels);
+    free(pixels);
+    free(super);
+    free(faceIds);
+    return 0;
+}
+
+// --lod against full traces of the scene at 60 frames per second of the
+// default rotation (and --fly): time per frame including the per-frame
+// setup, color error, and popping, counted as instances changing LOD and
+// as the frame-to-frame change the LOD frames show beyond the full ones'.
+static int benchLod(const Options *opts) {
+    int width = WINDOW_WIDTH, height = WINDOW_HEIGHT, frames = opts->benchLod;
+    uint32_t *full[2], *lod[2];
+    full[0] = malloc(sizeof(uint32_t) * width * height);
+    full[1] = malloc(sizeof(uint32_t) * width * height);
+    lod[0] = malloc(sizeof(uint32_t) * width * height);
+    lod[1] = malloc(sizeof(uint32_t) * width * height);
+    uint8_t *faceIds = malloc((size_t)width * height);
+    Background bg = { BG_SOLID, BG_COLOR, 0, 0, NULL, 0, 0, NULL, 0 };
+    Scene sc;
+    SceneView view;
+    WorkerPool pool;
+    memset(&view, 0, sizeof(view));
+    if (sceneOpen(&sc, opts->scenePath, (size_t)opts->sceneBudget << 20) < 0)
+        return 1;
+    uint8_t *level = malloc(sc.header->numInstances ? sc.header->numInstances : 1);
+    if (!full[0] || !full[1] || !lod[0] || !lod[1] || !faceIds || !level ||
+        ensureBackground(&bg, width, height) < 0 || poolInit(&pool, opts->threads) < 0) {
+        fprintf(stderr, "Failed to set up the LOD benchmark\n");
+        return 1;
+    }
+    memset(level, 0xFF, sc.header->numInstances);
+    Frame frame = { width, height, NULL, faceIds, 0, 0 };
+    RenderContext ctx;
+    memset(&ctx, 0, sizeof(ctx));
+    setCamera(&ctx, (Vec3){ 0, 0, -5 }, (Vec3){ 0, 0, 0 }, (Vec3){ 0, 1, 0 });
+    ctx.scaleFactor = 300.0;
+    ctx.halfWidth = width / 2.0;
+    ctx.halfHeight = height / 2.0;
+    ctx.frame = &frame;
+    ctx.background = bg.pixels;
+    ctx.scene = &view;
+    Vec3 lightDir = normalize((Vec3){ 1, 1, -1 });
+
+    double freq = (double)SDL_GetPerformanceFrequency();
+    view.lodSprite = opts->lodSprite;
+    view.lodDisc = opts->lodDisc;
+    Uint64 start = SDL_GetPerformanceCounter();
+    if (sceneBuild(&pool, &view, &sc, &ctx, NULL, lightDir) < 0)
+        return 1;
+    printf("Sprites: %u plane sets x %d views of %dx%d, %.1f ms to build\n", sc.header->numPlaneSets,
+           LOD_DIRS * LOD_DIRS, LOD_TEXELS, LOD_TEXELS, (SDL_GetPerformanceCounter() - start) * 1000 / freq);
+
+    double fullSec = 0, lodSec = 0, err = 0, flicker = 0;
+    long wrong = 0, switches = 0, counts[3] = { 0, 0, 0 };
+    for (int f = 0; f < frames; f++) {
+        double t = f / 60.0;
+        if (opts->flySpeed > 0)
+            flyCamera(&ctx, t, opts->flySpeed);
+        ctx.angle = t;
+        uint32_t *a = full[f & 1], *b = lod[f & 1];
+
+        view.lodSprite = 0;
+        start = SDL_GetPerformanceCounter();
+        frame.pixels = a;
+        if (sceneBuild(&pool, &view, &sc, &ctx, NULL, lightDir) < 0)
+            break;
+        renderFrame(&pool, &ctx, NULL);
+        fullSec += (SDL_GetPerformanceCounter() - start) / freq;
+
+        view.lodSprite = opts->lodSprite;
+        memset(view.lodCount, 0, sizeof(view.lodCount));
+        start = SDL_GetPerformanceCounter();
+        frame.pixels = b;
+        if (sceneBuild(&pool, &view, &sc, &ctx, NULL, lightDir) < 0)
+            break;
+        renderFrame(&pool, &ctx, NULL);
+        lodSec += (SDL_GetPerformanceCounter() - start) / freq;
+        for (int l = 0; l < 3; l++)
+            counts[l] += view.lodCount[l];
+        for (int i = 0; i < view.numItems; i++) {
+            const SceneItem *item = &view.items[i];
+            if (item->instance < 0)
+                continue;
+            if (level[item->instance] != 0xFF && level[item->instance] != item->lod)
+                switches++;
+            level[item->instance] = item->lod;
+        }
+
+        for (int p = 0; p < width * height; p++) {
+            double e = colorError(a[p], b[p]);
+            err += e;
+            wrong += e > 16;
+            if (f > 0)
+                flicker += fabs(colorError(b[p], lod[(f + 1) & 1][p]) - colorError(a[p], full[(f + 1) & 1][p]));
+        }
+    }
+    double pixels = (double)width * height * frames;
+    printf("Frames: %d, %.0f full, %.0f sprite and %.0f disc instances per frame (--lod %g --lod-disc %g)\n",
+           frames, (double)counts[LOD_FULL] / frames, (double)counts[LOD_SPRITE] / frames,
+           (double)counts[LOD_DISC] / frames, opts->lodSprite, opts->lodDisc);
+    printf("  full traces: %7.2f ms/frame\n", fullSec * 1000 / frames);
+    printf("  LOD:         %7.2f ms/frame, error vs full mean %.3f levels, %.3f%% of pixels off by more than 16\n",
+           lodSec * 1000 / frames, err / pixels, 100.0 * wrong / pixels);
+    printf("  popping: %.2f LOD changes per frame, %.3f levels per pixel of extra frame-to-frame change\n",
+           frames > 1 ? (double)switches / (frames - 1) : 0, frames > 1 ? flicker / (pixels - width * height) : 0);
+    poolDestroy(&pool);
+    sceneViewFree(&view);
+    sceneClose(&sc);
+    free(bg.pixels);
+    for (int i = 0; i < 2; i++) {
+        free(full[i]);
+        free(lod[i]);
+    }
+    free(faceIds);
+    free(level);
+    return 0;
+}
+
+/*
+ * Face ID recordings. Each frame is stored as the XOR against the previous
+ * frame (or against an all-miss frame for keyframes), run-length coded as
+ * (zero run, literal run, literal bytes) with varint lengths, next to the
+ * palette that frame was shaded with. An index at the end gives every
+ * frame's offset, so seeking is a jump to the keyframe at or before the
+ * target and at most REC_KEY_INTERVAL - 1 deltas from there.
+ */
+#define REC_MAGIC 0x43455244 // "DREC"
+#define REC_VERSION 1
+#define REC_KEY_INTERVAL 60
+
+typedef struct {
+    uint32_t magic, version;
+    uint32_t width, height;
+    uint32_t frameCount, keyInterval;
+    uint64_t indexOffset; // RecIndexEntry[frameCount], written on close
+} RecHeader;
+
+typedef struct {
+    uint64_t offset; // of the RecFrame
+    uint32_t size;   // RecFrame plus payload
+    uint32_t timeMs; // since the first frame
+} RecIndexEntry;
+
+typedef struct {
+    uint32_t payloadSize;
+    uint32_t keyframe;
+    double angle;
+    uint32_t palette[MAX_PLANES + 1]; // face colors, FACE_INSIDE last
+} RecFrame;
+
+typedef struct {
+    FILE *out;
+    RecHeader header;
+    RecIndexEntry *index;
+    int capacity;
+    uint8_t *prev, *payload;
+    uint64_t offset;
+    Uint32 startTicks;
+} Recorder;
+
+typedef struct {
+    uint8_t *map;
+    size_t mapSize;
+    RecHeader header;
+    const uint8_t *indexBase; // unaligned in the map, read through memcpy
+    uint8_t *ids;
+    int current; // frame held in ids, -1 before the first decode
+    RecFrame frame;
+} Player;
+
+static size_t putVarint(uint8_t *out, size_t v) {
+    size_t n = 0;
+    while (v >= 0x80) {
+        out[n++] = (uint8_t)(v | 0x80);
+        v >>= 7;
+    }
+    out[n++] = (uint8_t)v;
+    return n;
+}
+
+static int getVarint(const uint8_t *in, size_t size, size_t *pos, size_t *v) {
+    *v = 0;
+    for (int shift = 0; *pos < size && shift < 64; shift += 7) {
+        uint8_t b = in[(*pos)++];
+        *v |= (size_t)(b & 0x7F) << shift;
+        if (!(b & 0x80))
+            return 0;
+    }
+    return -1;
+}
+
+// XOR-delta + RLE of cur against ref. A literal run only ends at 8 equal
+// bytes, so short matches inside changed spans don't cost a token each.
+static size_t recEncode(const uint8_t *cur, const uint8_t *ref, size_t n, uint8_t *out) {
+    size_t i = 0, o = 0;
+    while (i < n) {
+        size_t start = i;
+        for (uint64_t a, b; i + 8 <= n; i += 8) {
+            memcpy(&a, cur + i, 8);
+            memcpy(&b, ref + i, 8);
+            if (a != b)
+                break;
+        }
+        while (i < n && cur[i] == ref[i])
+            i++;
+        size_t zeros = i - start, lit = i, same = 0;
+        while (i < n) {
+            same = (cur[i] == ref[i]) ? same + 1 : 0;
+            i++;
+            if (same == 8) {
+                i -= 8;
+                break;
+            }
+        }
+        o += putVarint(out + o, zeros);
+        o += putVarint(out + o, i - lit);
+        for (size_t k = lit; k < i; k++)
+            out[o++] = cur[k] ^ ref[k];
+    }
+    return o;
+}
+
+// Applies a payload to buf in place; literal runs are XORed a word at a time
+static int recDecode(const uint8_t *in, size_t size, uint8_t *buf, size_t n) {
+    size_t pos = 0, i = 0;
+    while (pos < size) {
+        size_t zeros, lit;
+        if (getVarint(in, size, &pos, &zeros) < 0 || getVarint(in, size, &pos, &lit) < 0)
+            return -1;
+        i += zeros;
+        if (i > n || lit > n - i || lit > size - pos)
+            return -1;
+        uint8_t *dst = buf + i;
+        const uint8_t *src = in + pos;
+        size_t k = 0;
+        for (uint64_t a, b; k + 8 <= lit; k += 8) {
+            memcpy(&a, dst + k, 8);
+            memcpy(&b, src + k, 8);
+            a ^= b;
+            memcpy(dst + k, &a, 8);
+        }
+        for (; k < lit; k++)
+            dst[k] ^= src[k];
+        i += lit;
+        pos += lit;
+    }
+    return 0;
+}
+
+static int recorderOpen(Recorder *rec, const char *path, int width, int height) {
+    memset(rec, 0, sizeof(*rec));
+    size_t n = (size_t)width * height;
+    rec->out = fopen(path, "wb");
+    rec->prev = malloc(n);
+    rec->payload = malloc(2 * n + 16);
+    if (!rec->out || !rec->prev || !rec->payload) {
+        fprintf(stderr, "Failed to open recording %s\n", path);
+        return -1;
+    }
+    rec->header = (RecHeader){ REC_MAGIC, REC_VERSION, width, height, 0, REC_KEY_INTERVAL, 0 };
+    // the header is rewritten on close, with the frame count and index offset
+    if (fwrite(&rec->header, sizeof(rec->header), 1, rec->out) != 1)
+        return -1;
+    rec->offset = sizeof(rec->header);
+    rec->startTicks = SDL_GetTicks();
+    return 0;
+}
+
+static int recorderFrame(Recorder *rec, const RenderContext *ctx) {
+    const Frame *frame = ctx->frame;
+    size_t n = (size_t)frame->width * frame->height;
+    int number = rec->header.frameCount;
+    if (number == rec->capacity) {
+        int capacity = rec->capacity ? rec->capacity * 2 : 1024;
+        RecIndexEntry *grown = realloc(rec->index, sizeof(RecIndexEntry) * capacity);
+        if (!grown)
+            return -1;
+        rec->index = grown;
+        rec->capacity = capacity;
+    }
+    RecFrame rf;
+    memset(&rf, 0, sizeof(rf));
+    rf.keyframe = (number % rec->header.keyInterval) == 0;
+    rf.angle = ctx->angle;
+    memcpy(rf.palette, ctx->faceColor, sizeof(uint32_t) * MAX_PLANES);
+    rf.palette[MAX_PLANES] = ctx->faceColor[FACE_INSIDE];
+    if (rf.keyframe)
+        memset(rec->prev, FACE_MISS, n);
+    rf.payloadSize = (uint32_t)recEncode(frame->faceIds, rec->prev, n, rec->payload);
+    memcpy(rec->prev, frame->faceIds, n);
+    if (fwrite(&rf, sizeof(rf), 1, rec->out) != 1 ||
+        fwrite(rec->payload, 1, rf.payloadSize, rec->out) != rf.payloadSize)
+        return -1;
+    rec->index[number] = (RecIndexEntry){ rec->offset, (uint32_t)(sizeof(rf) + rf.payloadSize),
+                                          SDL_GetTicks() - rec->startTicks };
+    rec->offset += sizeof(rf) + rf.payloadSize;
+    rec->header.frameCount++;
+    return 0;
+}
+
+static int recorderClose(Recorder *rec, const char *path) {
+    int rc = 0;
+    if (rec->out) {
+        rec->header.indexOffset = rec->offset;
+        rc |= fwrite(rec->index, sizeof(RecIndexEntry), rec->header.frameCount, rec->out) != rec->header.frameCount;
+        rc |= fseek(rec->out, 0, SEEK_SET) != 0;
+        rc |= fwrite(&rec->header, sizeof(rec->header), 1, rec->out) != 1;
+        rc |= fclose(rec->out) != 0;
+        if (rc)
+            fprintf(stderr, "Failed to finish recording %s\n", path);
+        else if (rec->header.frameCount > 0)
+            printf("Recorded %u frames to %s, %.1f KB per frame (raw %.1f KB)\n", rec->header.frameCount, path,
+                   rec->offset / 1024.0 / rec->header.frameCount,
+                   (double)rec->header.width * rec->header.height / 1024.0);
+    }
+    free(rec->index);
+    free(rec->prev);
+    free(rec->payload);
+    return rc ? -1 : 0;
+}
+
+static RecIndexEntry playerEntry(const Player *pl, int number) {
+    RecIndexEntry e;
+    memcpy(&e, pl->indexBase + sizeof(e) * number, sizeof(e));
+    return e;
+}
+
+static void playerClose(Player *pl) {
+    if (pl->map && pl->map != MAP_FAILED)
+        munmap(pl->map, pl->mapSize);
+    free(pl->ids);
+}
+
+// Maps the recording and checks every index entry against the file size
+static int playerOpen(Player *pl, const char *path) {
+    memset(pl, 0, sizeof(*pl));
+    pl->current = -1;
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(RecHeader)) {
+        fprintf(stderr, "Failed to open recording %s\n", path);
+        if (fd >= 0)
+            close(fd);
+        return -1;
+    }
+    pl->mapSize = st.st_size;
+    pl->map = mmap(NULL, pl->mapSize, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (pl->map == MAP_FAILED) {
+        fprintf(stderr, "Failed to map recording %s\n", path);
+        return -1;
+    }
+    memcpy(&pl->header, pl->map, sizeof(pl->header));
+    const RecHeader *h = &pl->header;
+    if (h->magic != REC_MAGIC || h->version != REC_VERSION || h->keyInterval == 0 ||
+        h->width == 0 || h->height == 0 || h->width > 16384 || h->height > 16384 ||
+        h->indexOffset > pl->mapSize ||
+        (pl->mapSize - h->indexOffset) / sizeof(RecIndexEntry) < h->frameCount) {
+        fprintf(stderr, "%s is not a complete recording\n", path);
+        playerClose(pl);
+        return -1;
+    }
+    pl->indexBase = pl->map + h->indexOffset;
+    for (uint32_t f = 0; f < h->frameCount; f++) {
+        RecIndexEntry e = playerEntry(pl, f);
+        if (e.size < sizeof(RecFrame) || e.offset > h->indexOffset || e.size > h->indexOffset - e.offset) {
+            fprintf(stderr, "%s: frame %u is out of bounds\n", path, f);
+            playerClose(pl);
+            return -1;
+        }
+    }
+    pl->ids = malloc((size_t)h->width * h->height);
+    if (!pl->ids) {
+        playerClose(pl);
+        return -1;
+    }
+    return 0;
+}
+
+// Leaves frame `number` in pl->ids and its palette in pl->frame. Runs
+// forward from the current frame when that is on the way, otherwise from
+// the keyframe before the target.
+static int playerSeek(Player *pl, int number) {
+    int key = number - number % pl->header.keyInterval;
+    int start = (pl->current >= key && pl->current <= number) ? pl->current + 1 : key;
+    size_t n = (size_t)pl->header.width * pl->header.height;
+    for (int f = start; f <= number; f++) {
+        RecIndexEntry e = playerEntry(pl, f);
+        RecFrame rf;
+        memcpy(&rf, pl->map + e.offset, sizeof(rf));
+        if (rf.payloadSize != e.size - sizeof(rf) || rf.keyframe != (f == key)) {
+            pl->current = -1;
+            return -1;
+        }
+        if (rf.keyframe)
+            memset(pl->ids, FACE_MISS, n);
+        if (recDecode(pl->map + e.offset + sizeof(rf), rf.payloadSize, pl->ids, n) < 0) {
+            pl->current = -1;
+            return -1;
+        }
+        pl->current = f;
+        pl->frame = rf;
+    }
+    return 0;
+}
+
+// Last frame recorded at or before timeMs
+static int playerFrameAt(const Player *pl, Uint32 timeMs) {
+    int lo = 0, hi = (int)pl->header.frameCount - 1;
+    while (lo < hi) {
+        int mid = (lo + hi + 1) / 2;
+        if (playerEntry(pl, mid).timeMs <= timeMs)
+            lo = mid;
+        else
+            hi = mid - 1;
+    }
+    return lo;
+}
+
+static void playerPalette(const Player *pl, uint32_t *faceColor) {
+    for (int i = 0; i < 256; i++)
+        faceColor[i] = BG_COLOR;
+    memcpy(faceColor, pl->frame.palette, sizeof(uint32_t) * MAX_PLANES);
+    faceColor[FACE_INSIDE] = pl->frame.palette[MAX_PLANES];
+}
+
+// Compression ratio, sequential decode rate and random seek latency
+static int benchPlayback(const char *path) {
+    Player pl;
+    if (playerOpen(&pl, path) < 0)
+        return 1;
+    int frames = pl.header.frameCount;
+    if (frames == 0) {
+        fprintf(stderr, "%s has no frames\n", path);
+        playerClose(&pl);
+        return 1;
+    }
+    double freq = (double)SDL_GetPerformanceFrequency();
+    Uint64 start = SDL_GetPerformanceCounter();
+    for (int f = 0; f < frames; f++) {
+        if (playerSeek(&pl, f) < 0) {
+            fprintf(stderr, "%s: frame %d is corrupt\n", path, f);
+            playerClose(&pl);
+            return 1;
+        }
+    }
+    double seqSec = (SDL_GetPerformanceCounter() - start) / freq;
+    int seeks = 200;
+    start = SDL_GetPerformanceCounter();
+    for (int s = 0; s < seeks; s++)
+        playerSeek(&pl, rand() % frames);
+    double seekSec = (SDL_GetPerformanceCounter() - start) / freq;
+    double duration = playerEntry(&pl, frames - 1).timeMs / 1000.0;
+    double raw = (double)pl.header.width * pl.header.height * frames;
+    printf("Recording: %d frames, %ux%u, %.1f s, %.1f KB per frame, %.1fx smaller than raw\n", frames,
+           pl.header.width, pl.header.height, duration, pl.header.indexOffset / 1024.0 / frames,
+           raw / pl.header.indexOffset);
+    printf("  sequential decode: %.3f ms/frame (%.0f fps, recorded at %.0f fps)\n", seqSec * 1000 / frames,
+           frames / seqSec, duration > 0 ? (frames - 1) / duration : 0);
+    printf("  random seek:       %.3f ms average (keyframe every %u frames)\n", seekSec * 1000 / seeks,
+           pl.header.keyInterval);
+    playerClose(&pl);
+    return 0;
+}
+
+// Plays a recording at its recorded speed, looping. Space pauses, left and
+// right jump 5 s (one frame while paused), Home restarts.
+static int playRecording(SDL_Renderer *renderer, SDL_Texture *texture, RenderContext *ctx, const char *path) {
+    Player pl;
+    if (playerOpen(&pl, path) < 0)
+        return 1;
+    Frame *frame = ctx->frame;
+    if (pl.header.width != (uint32_t)frame->width || pl.header.height != (uint32_t)frame->height ||
+        pl.header.frameCount == 0) {
+        fprintf(stderr, "%s: %ux%u with %u frames does not fit a %dx%d window\n", path,
+                pl.header.width, pl.header.height, pl.header.frameCount, frame->width, frame->height);
+        playerClose(&pl);
+        return 1;
+    }
+    uint8_t *ownIds = frame->faceIds;
+    frame->faceIds = pl.ids;
+    int last = (int)pl.header.frameCount - 1;
+    Uint32 duration = playerEntry(&pl, last).timeMs + 1;
+    Uint32 position = 0, lastTicks = SDL_GetTicks(), lastDebugTime = lastTicks;
+    Uint64 decodeTicks = 0;
+    int decoded = 0, paused = 0, running = 1, rc = 0;
+    SDL_Event event;
+    while (running) {
+        int step = 0;
+        while (SDL_PollEvent(&event)) {
+            if (event.type == SDL_QUIT)
+                running = 0;
+            if (event.type != SDL_KEYDOWN)
+                continue;
+            if (event.key.keysym.sym == SDLK_SPACE)
+                paused = !paused;
+            else if (event.key.keysym.sym == SDLK_HOME)
+                position = 0;
+            else if (event.key.keysym.sym == SDLK_RIGHT)
+                step = 1;
+            else if (event.key.keysym.sym == SDLK_LEFT)
+                step = -1;
+        }
+        Uint32 now = SDL_GetTicks();
+        if (!paused)
+            position += now - lastTicks;
+        lastTicks = now;
+        if (step && paused) {
+            int target = pl.current + step;
+            position = playerEntry(&pl, target < 0 ? last : target > last ? 0 : target).timeMs;
+        } else if (step) {
+            position = (step > 0) ? position + 5000 : (position > 5000 ? position - 5000 : 0);
+        }
+        position %= duration;
+
+        int target = playerFrameAt(&pl, position);
+        if (target != pl.current) {
+            Uint64 start = SDL_GetPerformanceCounter();
+            if (playerSeek(&pl, target) < 0) {
+                fprintf(stderr, "%s: frame %d is corrupt\n", path, target);
+                rc = 1;
+                break;
+            }
+            decodeTicks += SDL_GetPerformanceCounter() - start;
+            decoded++;
+        }
+        playerPalette(&pl, ctx->faceColor);
+        for (int y = 0; y < frame->height; y++)
+            resolveRow(ctx, y, 0, frame->width);
+
+        SDL_UpdateTexture(texture, NULL, frame->pixels, frame->width * sizeof(uint32_t));
+        SDL_RenderClear(renderer);
+        SDL_RenderCopy(renderer, texture, NULL, NULL);
+        SDL_RenderPresent(renderer);
+
+        if (now - lastDebugTime >= 1000) {
+            printf("Playback: frame %d/%d, angle %.2f rad%s", pl.current, last, pl.frame.angle, paused ? " (paused)" : "");
+            if (decoded)
+                printf(", decode %.3f ms per frame", decodeTicks * 1000.0 / SDL_GetPerformanceFrequency() / decoded);
+            printf("\n");
+            lastDebugTime = now;
+            decodeTicks = 0;
+            decoded = 0;
+        }
+        SDL_Delay(1);
+    }
+    frame->faceIds = ownIds;
+    playerClose(&pl);
+    return rc;
+}
+
+/*
+ * Control socket. A Unix-domain stream socket taking one command per line;
+ * the render loop polls it once per frame without blocking and applies
+ * what arrived at the frame boundary. Every command gets one reply line,
+ * "ok ..." or "error: ...".
+ *
+ *   threads N            resize the tile worker pool
+ *   speed X              rotation speed, 1 = one radian per second
+ *   kernel scalar|batch  per-pixel traceRay() or the SoA traceRays() rows
+ *   resolution WxH       render size, at most the window, scaled up on present
+ *   background SPEC      as --background
+ *   stats                timings since the previous stats
+ */
+#define CONTROL_MAX_CLIENTS 8
+#define CONTROL_LINE 256
+
+enum { CMD_THREADS, CMD_SPEED, CMD_KERNEL, CMD_RESOLUTION, CMD_BACKGROUND, CMD_STATS };
+
+typedef struct {
+    int fd; // -1 = free slot
+    char buf[CONTROL_LINE];
+    int len;
+} ControlClient;
+
+typedef struct {
+    int listenFd;
+    const char *path;
+    ControlClient clients[CONTROL_MAX_CLIENTS];
+} ControlServer;
+
+typedef struct {
+    int type;
+    int client;
+    int a, b;
+    double value;
+    char text[CONTROL_LINE];
+} ControlCommand;
+
+static int setNonBlocking(int fd) {
+    int flags = fcntl(fd, F_GETFL, 0);
+    return (flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0) ? -1 : 0;
+}
+
+static int controlOpen(ControlServer *cs, const char *path) {
+    memset(cs, 0, sizeof(*cs));
+    for (int i = 0; i < CONTROL_MAX_CLIENTS; i++)
+        cs->clients[i].fd = -1;
+    cs->path = path;
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "Control socket path too long: %s\n", path);
+        return -1;
+    }
+    strcpy(addr.sun_path, path);
+    cs->listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+    unlink(path); // a stale socket from a previous run
+    if (cs->listenFd < 0 || setNonBlocking(cs->listenFd) < 0 ||
+        bind(cs->listenFd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(cs->listenFd, 4) < 0) {
+        fprintf(stderr, "Failed to open control socket %s: %s\n", path, strerror(errno));
+        if (cs->listenFd >= 0)
+            close(cs->listenFd);
+        cs->listenFd = -1;
+        return -1;
+    }
+    return 0;
+}
+
+static void controlClose(ControlServer *cs) {
+    for (int i = 0; i < CONTROL_MAX_CLIENTS; i++) {
+        if (cs->clients[i].fd >= 0)
+            close(cs->clients[i].fd);
+    }
+    if (cs->listenFd >= 0) {
+        close(cs->listenFd);
+        unlink(cs->path);
+    }
+}
+
+static void controlReply(ControlServer *cs, int client, const char *fmt, ...) {
+    char line[512];
+    va_list args;
+    va_start(args, fmt);
+    int n = vsnprintf(line, sizeof(line) - 1, fmt, args);
+    va_end(args);
+    if (n < 0 || cs->clients[client].fd < 0)
+        return;
+    if (n > (int)sizeof(line) - 2)
+        n = sizeof(line) - 2;
+    line[n++] = '\n';
+    // replies are tiny; a client that can't take one is dropped, not waited on
+    if (send(cs->clients[client].fd, line, n, MSG_DONTWAIT | MSG_NOSIGNAL) != n) {
+        close(cs->clients[client].fd);
+        cs->clients[client].fd = -1;
+    }
+}
+
+static int controlParse(ControlServer *cs, int client, char *line, ControlCommand *cmd) {
+    char word[32], arg[CONTROL_LINE];
+    int fields = sscanf(line, "%31s %255s", word, arg);
+    if (fields < 1)
+        return 0;
+    cmd->client = client;
+    if (!strcmp(word, "threads") && fields == 2 && (cmd->a = atoi(arg)) >= 1 && cmd->a <= 65) {
+        cmd->type = CMD_THREADS;
+    } else if (!strcmp(word, "speed") && fields == 2) {
+        cmd->type = CMD_SPEED;
+        cmd->value = atof(arg);
+    } else if (!strcmp(word, "kernel") && fields == 2 && (!strcmp(arg, "scalar") || !strcmp(arg, "batch"))) {
+        cmd->type = CMD_KERNEL;
+        cmd->a = !strcmp(arg, "scalar");
+    } else if (!strcmp(word, "resolution") && fields == 2 && sscanf(arg, "%dx%d", &cmd->a, &cmd->b) == 2) {
+        cmd->type = CMD_RESOLUTION;
+    } else if (!strcmp(word, "background") && fields == 2) {
+        cmd->type = CMD_BACKGROUND;
+        strcpy(cmd->text, arg);
+    } else if (!strcmp(word, "stats") && fields == 1) {
+        cmd->type = CMD_STATS;
+    } else {
+        controlReply(cs, client, "error: unknown command or bad argument: %s", line);
+        return 0;
+    }
+    return 1;
+}
+
+// Accepts new clients and collects the complete lines that have arrived.
+// Returns the number of commands stored in cmds.
+static int controlPoll(ControlServer *cs, ControlCommand *cmds, int maxCmds) {
+    int fd, count = 0;
+    while ((fd = accept(cs->listenFd, NULL, NULL)) >= 0) {
+        int slot = 0;
+        while (slot < CONTROL_MAX_CLIENTS && cs->clients[slot].fd >= 0)
+            slot++;
+        if (slot == CONTROL_MAX_CLIENTS || setNonBlocking(fd) < 0) {
+            close(fd);
+            continue;
+        }
+        cs->clients[slot].fd = fd;
+        cs->clients[slot].len = 0;
+    }
+    for (int c = 0; c < CONTROL_MAX_CLIENTS; c++) {
+        ControlClient *cl = &cs->clients[c];
+        while (cl->fd >= 0) {
+            // lines left over from a full batch go before anything new is read
+            char *start = cl->buf, *nl;
+            while (count < maxCmds && cl->fd >= 0 && (nl = memchr(start, '\n', cl->len - (start - cl->buf)))) {
+                *nl = 0;
+                if (nl > start && nl[-1] == '\r')
+                    nl[-1] = 0;
+                count += controlParse(cs, c, start, &cmds[count]);
+                start = nl + 1;
+            }
+            cl->len -= start - cl->buf;
+            memmove(cl->buf, start, cl->len);
+            if (count == maxCmds || cl->fd < 0)
+                break;
+            if (cl->len == (int)sizeof(cl->buf) - 1) {
+                controlReply(cs, c, "error: line too long");
+                cl->len = 0;
+                continue;
+            }
+            ssize_t got = recv(cl->fd, cl->buf + cl->len, sizeof(cl->buf) - 1 - cl->len, MSG_DONTWAIT);
+            if (got < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+                break;
+            if (got <= 0) {
+                close(cl->fd);
+                cl->fd = -1;
+                break;
+            }
+            cl->len += got;
+        }
+    }
+    return count;
+}
+
+/*
+ * Prometheus text endpoint on 127.0.0.1. The render loop keeps its counters
+ * in a MetricsSnapshot of its own and publishes a copy once per frame under
+ * a sequence counter; the HTTP thread copies it out and retries if the
+ * count moved, so a scrape never holds up a frame.
+ */
+#define METRICS_BUCKETS 8
+#define METRICS_REFRESH_HZ 60 // frames longer than one refresh count as dropped ones
+
+enum { STAGE_RENDER, STAGE_AA, STAGE_AOV, STAGE_RECORD, STAGE_POST, STAGE_PRESENT, NUM_STAGES };
+
+static const char *stageNames[NUM_STAGES] = { "render", "aa", "aov", "record", "post", "present" };
+static const double frameBuckets[METRICS_BUCKETS - 1] = { 0.004, 0.008, 0.0167, 0.0333, 0.05, 0.1, 0.25 };
+
+typedef struct {
+    uint64_t frames;
+    uint64_t frameBuckets[METRICS_BUCKETS]; // per bucket, summed up when served; last is +Inf
+    double frameSeconds;
+    double stageSeconds[NUM_STAGES];
+    uint64_t rays;
+    uint64_t droppedFrames;
+    double planesPerPixel; // last frame
+    int threads;
+    double threadBusySeconds[65]; // since the pool was (re)started, slot 0 = render loop
+    double utilization;           // last frame, busy / (wall * threads)
+} MetricsSnapshot;
+
+typedef struct {
+    SDL_atomic_t seq; // odd while the render loop is writing snap
+    MetricsSnapshot snap;
+    int listenFd;
+    SDL_Thread *thread;
+    SDL_atomic_t quit;
+} MetricsServer;
+
+static void metricsPublish(MetricsServer *ms, const MetricsSnapshot *live) {
+    SDL_AtomicIncRef(&ms->seq);
+    SDL_MemoryBarrierRelease();
+    ms->snap = *live;
+    SDL_MemoryBarrierRelease();
+    SDL_AtomicIncRef(&ms->seq);
+}
+
+static void metricsRead(MetricsServer *ms, MetricsSnapshot *out) {
+    for (;;) {
+        int before = SDL_AtomicGet(&ms->seq);
+        if (before & 1) {
+            SDL_Delay(0);
+            continue;
+        }
+        SDL_MemoryBarrierAcquire();
+        *out = ms->snap;
+        SDL_MemoryBarrierAcquire();
+        if (SDL_AtomicGet(&ms->seq) == before)
+            return;
+    }
+}
+
+static void metricsRecordFrame(MetricsSnapshot *m, double seconds) {
+    int b = 0;
+    while (b < METRICS_BUCKETS - 1 && seconds > frameBuckets[b])
+        b++;
+    m->frameBuckets[b]++;
+    m->frames++;
+    m->frameSeconds += seconds;
+    int intervals = (int)(seconds * METRICS_REFRESH_HZ + 0.5);
+    if (intervals > 1)
+        m->droppedFrames += intervals - 1;
+}
+
+static size_t metricsFormat(const MetricsSnapshot *m, char *buf, size_t size) {
+    size_t n = 0;
+#define EMIT(...) (n += snprintf(buf + n, n < size ? size - n : 0, __VA_ARGS__))
+    EMIT("# HELP dodeca_frame_seconds Time between presented frames.\n"
+         "# TYPE dodeca_frame_seconds histogram\n");
+    uint64_t cumulative = 0;
+    for (int b = 0; b < METRICS_BUCKETS; b++) {
+        cumulative += m->frameBuckets[b];
+        if (b < METRICS_BUCKETS - 1)
+            EMIT("dodeca_frame_seconds_bucket{le=\"%g\"} %llu\n", frameBuckets[b], (unsigned long long)cumulative);
+        else
+            EMIT("dodeca_frame_seconds_bucket{le=\"+Inf\"} %llu\n", (unsigned long long)cumulative);
+    }
+    EMIT("dodeca_frame_seconds_sum %.6f\ndodeca_frame_seconds_count %llu\n",
+         m->frameSeconds, (unsigned long long)m->frames);
+    EMIT("# HELP dodeca_stage_seconds_total Time spent in each stage of the frame.\n"
+         "# TYPE dodeca_stage_seconds_total counter\n");
+    for (int s = 0; s < NUM_STAGES; s++)
+        EMIT("dodeca_stage_seconds_total{stage=\"%s\"} %.6f\n", stageNames[s], m->stageSeconds[s]);
+    EMIT("# HELP dodeca_rays_total Primary rays traced.\n# TYPE dodeca_rays_total counter\n"
+         "dodeca_rays_total %llu\n", (unsigned long long)m->rays);
+    EMIT("# HELP dodeca_planes_per_pixel Plane tests per pixel in the last frame.\n"
+         "# TYPE dodeca_planes_per_pixel gauge\ndodeca_planes_per_pixel %.4f\n", m->planesPerPixel);
+    EMIT("# HELP dodeca_dropped_frames_total Refresh intervals missed at %d Hz.\n"
+         "# TYPE dodeca_dropped_frames_total counter\ndodeca_dropped_frames_total %llu\n",
+         METRICS_REFRESH_HZ, (unsigned long long)m->droppedFrames);
+    EMIT("# HELP dodeca_threads Tile worker threads including the render loop.\n"
+         "# TYPE dodeca_threads gauge\ndodeca_threads %d\n", m->threads);
+    EMIT("# HELP dodeca_thread_busy_seconds_total Time each thread spent running jobs since the pool started.\n"
+         "# TYPE dodeca_thread_busy_seconds_total counter\n");
+    for (int t = 0; t < m->threads && t < 65; t++)
+        EMIT("dodeca_thread_busy_seconds_total{thread=\"%d\"} %.6f\n", t, m->threadBusySeconds[t]);
+    EMIT("# HELP dodeca_thread_utilization Share of the last frame the threads spent running jobs.\n"
+         "# TYPE dodeca_thread_utilization gauge\ndodeca_thread_utilization %.4f\n", m->utilization);
+#undef EMIT
+    return n;
+}
+
+static void metricsServe(MetricsServer *ms, int fd) {
+    char request[2048];
+    size_t len = 0;
+    struct timeval timeout = { 1, 0 };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    while (len < sizeof(request) - 1) {
+        ssize_t got = recv(fd, request + len, sizeof(request) - 1 - len, 0);
+        if (got <= 0)
+            return;
+        len += got;
+        request[len] = 0;
+        if (strstr(request, "\r\n\r\n") || strstr(request, "\n\n"))
+            break;
+    }
+    request[len] = 0;
+    char body[16384];
+    const char *status = "200 OK";
+    size_t bodyLen;
+    if (!strncmp(request, "GET /metrics ", 13) || !strncmp(request, "GET / ", 6)) {
+        MetricsSnapshot snap;
+        metricsRead(ms, &snap);
+        bodyLen = metricsFormat(&snap, body, sizeof(body));
+        if (bodyLen >= sizeof(body))
+            bodyLen = sizeof(body) - 1;
+    } else {
+        status = "404 Not Found";
+        bodyLen = snprintf(body, sizeof(body), "try /metrics\n");
+    }
+    char head[256];
+    int headLen = snprintf(head, sizeof(head), "HTTP/1.0 %s\r\nContent-Type: text/plain; version=0.0.4\r\n"
+                           "Content-Length: %zu\r\nConnection: close\r\n\r\n", status, bodyLen);
+    if (send(fd, head, headLen, MSG_NOSIGNAL) == headLen)
+        send(fd, body, bodyLen, MSG_NOSIGNAL);
+}
+
+static int metricsMain(void *data) {
+    MetricsServer *ms = data;
+    while (!SDL_AtomicGet(&ms->quit)) {
+        struct pollfd pfd = { ms->listenFd, POLLIN, 0 };
+        if (poll(&pfd, 1, 200) <= 0)
+            continue;
+        int fd = accept(ms->listenFd, NULL, NULL);
+        if (fd < 0)
+            continue;
+        metricsServe(ms, fd);
+        close(fd);
+    }
+    return 0;
+}
+
+static int metricsOpen(MetricsServer *ms, int port) {
+    memset(ms, 0, sizeof(*ms));
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons((uint16_t)port);
+    int one = 1;
+    ms->listenFd = socket(AF_INET, SOCK_STREAM, 0);
+    if (ms->listenFd < 0 || setsockopt(ms->listenFd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)) < 0 ||
+        bind(ms->listenFd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(ms->listenFd, 8) < 0) {
+        fprintf(stderr, "Failed to listen on 127.0.0.1:%d: %s\n", port, strerror(errno));
+        if (ms->listenFd >= 0)
+            close(ms->listenFd);
+        return -1;
+    }
+    ms->thread = SDL_CreateThread(metricsMain, "metrics", ms);
+    if (!ms->thread) {
+        close(ms->listenFd);
+        return -1;
+    }
+    return 0;
+}
+
+static void metricsClose(MetricsServer *ms) {
+    SDL_AtomicSet(&ms->quit, 1);
+    SDL_WaitThread(ms->thread, NULL);
+    close(ms->listenFd);
+}
+
+/*
+ * Frame streaming over TCP. The render loop drops the finished face IDs and
+ * palette into a one-slot mailbox; a stream thread encodes them with the
+ * recording coder (XOR against the previous frame + RLE) and feeds each
+ * client from its own short queue of shared, refcounted messages. A client
+ * that falls STREAM_QUEUE frames behind loses its backlog and gets a
+ * keyframe next, so a slow viewer never holds up the renderer or the
+ * other viewers. Message: StreamHeader, then the RecFrame payload.
+ */
+#define STREAM_MAGIC 0x52545344 // "DSTR"
+#define STREAM_MAX_CLIENTS 8
+#define STREAM_QUEUE 4
+
+typedef struct {
+    uint32_t magic;
+    uint32_t frameNumber;
+    uint32_t width, height;
+    RecFrame frame;
+} StreamHeader;
+
+typedef struct {
+    int refs;
+    size_t size;
+    uint8_t data[]; // StreamHeader + payload
+} StreamMessage;
+
+typedef struct {
+    int fd; // -1 = free slot
+    StreamMessage *queue[STREAM_QUEUE];
+    int head, count;
+    size_t sent; // bytes of the head message already written
+    int needsKey;
+} StreamClient;
+
+typedef struct {
+    int listenFd;
+    int wake[2]; // self-pipe, written when a frame is posted
+    SDL_Thread *thread;
+    SDL_mutex *lock;
+    uint8_t *pending, *working, *prev; // mailbox, encoder's copy, last frame sent
+    StreamHeader pendingHeader;
+    int hasPending;
+    int prevWidth, prevHeight;
+    size_t maxPixels;
+    uint8_t *payload;
+    StreamClient clients[STREAM_MAX_CLIENTS];
+    SDL_atomic_t quit;
+    SDL_atomic_t numClients;
+    SDL_atomic_t bytesSent;     // since the last stats line
+    SDL_atomic_t droppedClient; // frames a client skipped through backpressure
+    SDL_atomic_t droppedSource; // frames overwritten before the encoder took them
+} StreamServer;
+
+static StreamMessage *streamMessage(const StreamHeader *header, const uint8_t *payload) {
+    StreamMessage *msg = malloc(sizeof(StreamMessage) + sizeof(StreamHeader) + header->frame.payloadSize);
+    if (!msg)
+        return NULL;
+    msg->refs = 0;
+    msg->size = sizeof(StreamHeader) + header->frame.payloadSize;
+    memcpy(msg->data, header, sizeof(StreamHeader));
+    memcpy(msg->data + sizeof(StreamHeader), payload, header->frame.payloadSize);
+    return msg;
+}
+
+static void streamRelease(StreamMessage *msg) {
+    if (--msg->refs == 0)
+        free(msg);
+}
+
+static void streamDropClient(StreamServer *ss, StreamClient *cl) {
+    for (int q = 0; q < cl->count; q++)
+        streamRelease(cl->queue[(cl->head + q) % STREAM_QUEUE]);
+    close(cl->fd);
+    cl->fd = -1;
+    cl->count = 0;
+    SDL_AtomicAdd(&ss->numClients, -1);
+}
+
+static void streamEnqueue(StreamClient *cl, StreamMessage *msg) {
+    msg->refs++;
+    cl->queue[(cl->head + cl->count++) % STREAM_QUEUE] = msg;
+}
+
+// Encodes the frame in ss->working and queues it: a keyframe for clients
+// that need one, the delta against the previous frame for the rest
+static void streamEncode(StreamServer *ss, StreamHeader header) {
+    size_t n = (size_t)header.width * header.height;
+    int needKey = 0, needDelta = 0;
+    for (int c = 0; c < STREAM_MAX_CLIENTS; c++) {
+        StreamClient *cl = &ss->clients[c];
+        if (cl->fd < 0)
+            continue;
+        if (cl->count == STREAM_QUEUE) {
+            // keep only a half-sent head, the byte stream has to stay whole
+            int keep = cl->sent > 0;
+            for (int q = keep; q < cl->count; q++)
+                streamRelease(cl->queue[(cl->head + q) % STREAM_QUEUE]);
+            SDL_AtomicAdd(&ss->droppedClient, cl->count - keep);
+            cl->count = keep;
+            cl->needsKey = 1;
+        }
+        if ((int)header.width != ss->prevWidth || (int)header.height != ss->prevHeight)
+            cl->needsKey = 1;
+        needKey |= cl->needsKey;
+        needDelta |= !cl->needsKey;
+    }
+    StreamMessage *key = NULL, *delta = NULL;
+    if (needDelta) {
+        header.frame.keyframe = 0;
+        header.frame.payloadSize = (uint32_t)recEncode(ss->working, ss->prev, n, ss->payload);
+        delta = streamMessage(&header, ss->payload);
+    }
+    if (needKey) {
+        memset(ss->prev, FACE_MISS, n);
+        header.frame.keyframe = 1;
+        header.frame.payloadSize = (uint32_t)recEncode(ss->working, ss->prev, n, ss->payload);
+        key = streamMessage(&header, ss->payload);
+    }
+    memcpy(ss->prev, ss->working, n);
+    ss->prevWidth = header.width;
+    ss->prevHeight = header.height;
+    for (int c = 0; c < STREAM_MAX_CLIENTS; c++) {
+        StreamClient *cl = &ss->clients[c];
+        StreamMessage *msg = cl->needsKey ? key : delta;
+        if (cl->fd < 0)
+            continue;
+        if (!msg) {
+            cl->needsKey = 1; // out of memory, try again with the next frame
+            continue;
+        }
+        streamEnqueue(cl, msg);
+        cl->needsKey = 0;
+    }
+    if (key && key->refs == 0)
+        free(key);
+    if (delta && delta->refs == 0)
+        free(delta);
+}
+
+static void streamFlush(StreamServer *ss, StreamClient *cl) {
+    while (cl->count > 0) {
+        StreamMessage *msg = cl->queue[cl->head];
+        ssize_t got = send(cl->fd, msg->data + cl->sent, msg->size - cl->sent, MSG_DONTWAIT | MSG_NOSIGNAL);
+        if (got < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+            return;
+        if (got <= 0) {
+            streamDropClient(ss, cl);
+            return;
+        }
+        SDL_AtomicAdd(&ss->bytesSent, (int)got);
+        cl->sent += got;
+        if (cl->sent < msg->size)
+            return;
+        streamRelease(msg);
+        cl->head = (cl->head + 1) % STREAM_QUEUE;
+        cl->count--;
+        cl->sent = 0;
+    }
+}
+
+static int streamMain(void *data) {
+    StreamServer *ss = data;
+    while (!SDL_AtomicGet(&ss->quit)) {
+        struct pollfd pfd[2 + STREAM_MAX_CLIENTS];
+        pfd[0] = (struct pollfd){ ss->listenFd, POLLIN, 0 };
+        pfd[1] = (struct pollfd){ ss->wake[0], POLLIN, 0 };
+        for (int c = 0; c < STREAM_MAX_CLIENTS; c++) {
+            const StreamClient *cl = &ss->clients[c];
+            pfd[2 + c] = (struct pollfd){ cl->fd, cl->count > 0 ? POLLOUT : 0, 0 };
+        }
+        if (poll(pfd, 2 + STREAM_MAX_CLIENTS, 200) <= 0)
+            continue;
+        if (pfd[0].revents & POLLIN) {
+            int fd = accept(ss->listenFd, NULL, NULL);
+            int slot = 0;
+            while (slot < STREAM_MAX_CLIENTS && ss->clients[slot].fd >= 0)
+                slot++;
+            if (fd >= 0 && (slot == STREAM_MAX_CLIENTS || setNonBlocking(fd) < 0)) {
+                close(fd);
+            } else if (fd >= 0) {
+                int one = 1;
+                setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+                ss->clients[slot] = (StreamClient){ fd, { NULL }, 0, 0, 0, 1 };
+                SDL_AtomicAdd(&ss->numClients, 1);
+            }
+        }
+        if (pfd[1].revents & POLLIN) {
+            char drain[64];
+            while (read(ss->wake[0], drain, sizeof(drain)) > 0)
+                ;
+            SDL_LockMutex(ss->lock);
+            int ready = ss->hasPending;
+            StreamHeader header = ss->pendingHeader;
+            if (ready) {
+                uint8_t *swap = ss->pending;
+                ss->pending = ss->working;
+                ss->working = swap;
+                ss->hasPending = 0;
+            }
+            SDL_UnlockMutex(ss->lock);
+            if (ready)
+                streamEncode(ss, header);
+        }
+        for (int c = 0; c < STREAM_MAX_CLIENTS; c++) {
+            StreamClient *cl = &ss->clients[c];
+            if (cl->fd >= 0 && (pfd[2 + c].revents & (POLLERR | POLLHUP)))
+                streamDropClient(ss, cl);
+            else if (cl->fd >= 0)
+                streamFlush(ss, cl);
+        }
+    }
+    return 0;
+}
+
+static int streamOpen(StreamServer *ss, int port, int maxWidth, int maxHeight) {
+    memset(ss, 0, sizeof(*ss));
+    ss->wake[0] = ss->wake[1] = -1;
+    for (int c = 0; c < STREAM_MAX_CLIENTS; c++)
+        ss->clients[c].fd = -1;
+    ss->maxPixels = (size_t)maxWidth * maxHeight;
+    ss->pending = malloc(ss->maxPixels);
+    ss->working = malloc(ss->maxPixels);
+    ss->prev = malloc(ss->maxPixels);
+    ss->payload = malloc(2 * ss->maxPixels + 16);
+    ss->lock = SDL_CreateMutex();
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons((uint16_t)port);
+    int one = 1;
+    ss->listenFd = socket(AF_INET, SOCK_STREAM, 0);
+    if (!ss->pending || !ss->working || !ss->prev || !ss->payload || !ss->lock || ss->listenFd < 0 ||
+        setsockopt(ss->listenFd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)) < 0 ||
+        bind(ss->listenFd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(ss->listenFd, 4) < 0 ||
+        setNonBlocking(ss->listenFd) < 0 || pipe(ss->wake) < 0 ||
+        setNonBlocking(ss->wake[0]) < 0 || setNonBlocking(ss->wake[1]) < 0) {
+        fprintf(stderr, "Failed to start frame streaming on port %d: %s\n", port, strerror(errno));
+        return -1;
+    }
+    ss->thread = SDL_CreateThread(streamMain, "stream", ss);
+    return ss->thread ? 0 : -1;
+}
+
+// Hands the frame to the stream thread. Never waits on it: a frame still
+// in the mailbox is replaced and counted as dropped.
+static void streamPost(StreamServer *ss, const RenderContext *ctx, uint32_t frameNumber) {
+    const Frame *frame = ctx->frame;
+    size_t n = (size_t)frame->width * frame->height;
+    if (SDL_AtomicGet(&ss->numClients) == 0 || n > ss->maxPixels)
+        return;
+    SDL_LockMutex(ss->lock);
+    if (ss->hasPending)
+        SDL_AtomicAdd(&ss->droppedSource, 1);
+    memcpy(ss->pending, frame->faceIds, n);
+    StreamHeader *h = &ss->pendingHeader;
+    memset(h, 0, sizeof(*h));
+    h->magic = STREAM_MAGIC;
+    h->frameNumber = frameNumber;
+    h->width = frame->width;
+    h->height = frame->height;
+    h->frame.angle = ctx->angle;
+    memcpy(h->frame.palette, ctx->faceColor, sizeof(uint32_t) * MAX_PLANES);
+    h->frame.palette[MAX_PLANES] = ctx->faceColor[FACE_INSIDE];
+    ss->hasPending = 1;
+    SDL_UnlockMutex(ss->lock);
+    if (write(ss->wake[1], "", 1) < 0 && errno != EAGAIN)
+        fprintf(stderr, "Stream wakeup failed: %s\n", strerror(errno));
+}
+
+static void streamClose(StreamServer *ss) {
+    SDL_AtomicSet(&ss->quit, 1);
+    SDL_WaitThread(ss->thread, NULL);
+    for (int c = 0; c < STREAM_MAX_CLIENTS; c++) {
+        if (ss->clients[c].fd >= 0)
+            streamDropClient(ss, &ss->clients[c]);
+    }
+    close(ss->listenFd);
+    close(ss->wake[0]);
+    close(ss->wake[1]);
+    SDL_DestroyMutex(ss->lock);
+    free(ss->pending);
+    free(ss->working);
+    free(ss->prev);
+    free(ss->payload);
+}
+
+static int connectTo(const char *hostPort) {
+    char host[256];
+    const char *colon = strrchr(hostPort, ':');
+    if (!colon || colon - hostPort >= (int)sizeof(host)) {
+        fprintf(stderr, "Expected HOST:PORT, got %s\n", hostPort);
+        return -1;
+    }
+    memcpy(host, hostPort, colon - hostPort);
+    host[colon - hostPort] = 0;
+    struct addrinfo hints, *res, *ai;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    int err = getaddrinfo(host, colon + 1, &hints, &res);
+    if (err != 0) {
+        fprintf(stderr, "Cannot resolve %s: %s\n", host, gai_strerror(err));
+        return -1;
+    }
+    int fd = -1;
+    for (ai = res; ai && fd < 0; ai = ai->ai_next) {
+        fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (fd >= 0 && connect(fd, ai->ai_addr, ai->ai_addrlen) < 0) {
+            close(fd);
+            fd = -1;
+        }
+    }
+    freeaddrinfo(res);
+    if (fd < 0)
+        fprintf(stderr, "Cannot connect to %s: %s\n", hostPort, strerror(errno));
+    return fd;
+}
+
+// Viewer for --stream: decodes every message as it arrives and shows the
+// latest frame, resizing the texture to whatever the server sends
+static int viewStream(SDL_Renderer *renderer, SDL_Texture **texture, RenderContext *ctx, Background *bg,
+                      const char *hostPort) {
+    int fd = connectTo(hostPort);
+    if (fd < 0)
+        return 1;
+    Frame *frame = ctx->frame;
+    size_t capacity = 1 << 16, have = 0;
+    uint8_t *buf = malloc(capacity), *ids = NULL;
+    uint32_t *pixels = NULL;
+    int width = 0, height = 0, haveKey = 0, running = 1, rc = 0;
+    uint32_t shown = 0, lastNumber = 0;
+    Uint32 lastDebugTime = SDL_GetTicks();
+    uint64_t bytes = 0;
+    SDL_Event event;
+    while (running && buf) {
+        while (SDL_PollEvent(&event)) {
+            if (event.type == SDL_QUIT)
+                running = 0;
+        }
+        struct pollfd pfd = { fd, POLLIN, 0 };
+        if (poll(&pfd, 1, 20) > 0) {
+            if (have == capacity) {
+                uint8_t *grown = realloc(buf, capacity * 2);
+                if (!grown)
+                    break;
+                buf = grown;
+                capacity *= 2;
+            }
+            ssize_t got = recv(fd, buf + have, capacity - have, 0);
+            if (got <= 0) {
+                printf("Stream closed by %s\n", hostPort);
+                break;
+            }
+            have += got;
+            bytes += got;
+        }
+        int updated = 0;
+        size_t used = 0;
+        while (have - used >= sizeof(StreamHeader)) {
+            StreamHeader h;
+            memcpy(&h, buf + used, sizeof(h));
+            if (h.magic != STREAM_MAGIC || h.width == 0 || h.height == 0 || h.width > 16384 || h.height > 16384 ||
+                h.frame.payloadSize > 2 * h.width * h.height + 16) {
+                fprintf(stderr, "Bad stream message from %s\n", hostPort);
+                running = 0;
+                rc = 1;
+                break;
+            }
+            if (have - used < sizeof(h) + h.frame.payloadSize)
+                break;
+            if ((int)h.width != width || (int)h.height != height) {
+                uint8_t *newIds = realloc(ids, (size_t)h.width * h.height);
+                uint32_t *newPixels = realloc(pixels, sizeof(uint32_t) * h.width * h.height);
+                ids = newIds ? newIds : ids;
+                pixels = newPixels ? newPixels : pixels;
+                SDL_DestroyTexture(*texture);
+                *texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING,
+                                             h.width, h.height);
+                if (!newIds || !newPixels || !*texture || ensureBackground(bg, h.width, h.height) < 0) {
+                    fprintf(stderr, "Failed to resize the viewer to %ux%u\n", h.width, h.height);
+                    running = 0;
+                    rc = 1;
+                    break;
+                }
+                width = h.width;
+                height = h.height;
+                haveKey = 0;
+            }
+            size_t n = (size_t)width * height;
+            if (h.frame.keyframe) {
+                memset(ids, FACE_MISS, n);
+                haveKey = 1;
+            }
+            if (haveKey && recDecode(buf + used + sizeof(h), h.frame.payloadSize, ids, n) < 0) {
+                fprintf(stderr, "Corrupt frame %u from %s\n", h.frameNumber, hostPort);
+                haveKey = 0;
+            }
+            if (haveKey) {
+                for (int i = 0; i < 256; i++)
+                    ctx->faceColor[i] = BG_COLOR;
+                memcpy(ctx->faceColor, h.frame.palette, sizeof(uint32_t) * MAX_PLANES);
+                ctx->faceColor[FACE_INSIDE] = h.frame.palette[MAX_PLANES];
+                updated = 1;
+                lastNumber = h.frameNumber;
+            }
+            used += sizeof(h) + h.frame.payloadSize;
+        }
+        memmove(buf, buf + used, have - used);
+        have -= used;
+
+        if (updated) {
+            // resolveRow() reads the frame through ctx, point it at the stream's buffers
+            Frame view = { width, height, pixels, ids, 0, 0 };
+            ctx->frame = &view;
+            ctx->background = bg->pixels;
+            for (int y = 0; y < height; y++)
+                resolveRow(ctx, y, 0, width);
+            ctx->frame = frame;
+            SDL_UpdateTexture(*texture, NULL, pixels, width * sizeof(uint32_t));
+            SDL_RenderClear(renderer);
+            SDL_RenderCopy(renderer, *texture, NULL, NULL);
+            SDL_RenderPresent(renderer);
+            shown++;
+        }
+        Uint32 now = SDL_GetTicks();
+        if (now - lastDebugTime >= 1000) {
+            printf("View: %u frames shown, last #%u, %ux%u, %.1f KB/s\n", shown, lastNumber, width, height,
+                   bytes / 1.024 / (now - lastDebugTime));
+            lastDebugTime = now;
+            shown = 0;
+            bytes = 0;
+        }
+    }
+    close(fd);
+    free(buf);
+    free(ids);
+    free(pixels);
+    return rc;
+}
+
+#ifndef DODECAHEDRON_NO_MAIN
+int main(int argc, char* argv[]) {
+    Options opts;
+    int parsed = parseOptions(argc, argv, &opts);
+    if (parsed != 0)
+        return parsed < 0 ? 1 : 0;
+
+    // Seed random generator (no longer used I like bloat)
+    srand((unsigned int)SDL_GetTicks());
+
+    double modelScale = 0.5;
+    Vec3 scaledVertices[NUM_VERTICES];
+    for (int i = 0; i < NUM_VERTICES; i++) {
+        scaledVertices[i] = scale(baseVertices[i], modelScale);
+    }
+
+    Plane basePlanes[MAX_PLANES];
+    int numPlanes = computeBasePlanes(scaledVertices, NUM_VERTICES, basePlanes, MAX_PLANES);
+    if (numPlanes != 12) {
+        printf("Warning: Expected 12 planes, but got %d\n", numPlanes);
+    }
+
+    if (opts.benchRays > 0)
+        return benchRays(basePlanes, numPlanes, opts.benchRays, opts.threads);
+    if (opts.benchPoints > 0)
+        return benchPoints(basePlanes, numPlanes, opts.benchPoints, opts.threads);
+    if (opts.benchPlay)
+        return benchPlayback(opts.benchPlay);
+    if (opts.benchCoverage > 0)
+        return benchCoverage(basePlanes, numPlanes, opts.benchCoverage, opts.threads);
+    if (opts.benchLod > 0)
+        return benchLod(&opts);
+    if (opts.meshPath)
+        return exportMesh(basePlanes, numPlanes, opts.meshPath);
+    if (opts.testScene)
+        return testScene();
+    if (opts.writeScenePath)
+        return writeScene(opts.writeScenePath, opts.writeSceneCount > 0 ? opts.writeSceneCount : 1,
+                          opts.writeSceneField);
+    if (opts.voxelRes > 0) {
+        double extent = 0;
+        for (int i = 0; i < NUM_VERTICES; i++)
+            extent = fmax(extent, fmax(fabs(scaledVertices[i].x), fmax(fabs(scaledVertices[i].y), fabs(scaledVertices[i].z))));
+        WorkerPool pool;
+        if (poolInit(&pool, opts.threads) < 0)
+            return 1;
+        int rc = voxelize(&pool, basePlanes, numPlanes, extent * 1.05, opts.voxelRes, opts.voxelPath, opts.voxelSdf);
+        poolDestroy(&pool);
+        return rc;
+    }
+
+    if (SDL_Init(SDL_INIT_VIDEO) < 0) {
+        fprintf(stderr, "SDL_Init Error: %s\n", SDL_GetError());
+        return 1;
+    }
+    SDL_Window *window = SDL_CreateWindow("Dodecahedron",
+                                          SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED,
+                                          WINDOW_WIDTH, WINDOW_HEIGHT, SDL_WINDOW_SHOWN);
+    if (!window) {
+        fprintf(stderr, "SDL_CreateWindow Error: %s\n", SDL_GetError());
+        SDL_Quit();
+        return 1;
+    }
+    SDL_Renderer *renderer = SDL_CreateRenderer(window, -1,
+                               SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC);
+    if (!renderer) {
+        fprintf(stderr, "SDL_CreateRenderer Error: %s\n", SDL_GetError());
+        SDL_DestroyWindow(window);
+        SDL_Quit();
+        return 1;
+    }
+    SDL_Texture *texture = SDL_CreateTexture(renderer,
+                         SDL_PIXELFORMAT_ARGB8888,
+                         SDL_TEXTUREACCESS_STREAMING,
+                         WINDOW_WIDTH, WINDOW_HEIGHT);
+    if (!texture) {
+        fprintf(stderr, "SDL_CreateTexture Error: %s\n", SDL_GetError());
+        SDL_DestroyRenderer(renderer);
+        SDL_DestroyWindow(window);
+        SDL_Quit();
+        return 1;
+    }
+
+    uint32_t *pixels = malloc(WINDOW_WIDTH * WINDOW_HEIGHT * sizeof(uint32_t));
+    uint8_t *faceIds = malloc(WINDOW_WIDTH * WINDOW_HEIGHT);
+    if (!pixels || !faceIds) {
+        free(pixels);
+        free(faceIds);
+        fprintf(stderr, "Failed to allocate pixel buffer\n");
+        SDL_DestroyTexture(texture);
+        SDL_DestroyRenderer(renderer);
+        SDL_DestroyWindow(window);
+        SDL_Quit();
+        return 1;
+    }
+
+    Frame frame = { WINDOW_WIDTH, WINDOW_HEIGHT, pixels, faceIds, 0, 0 };
+
+    WorkerPool pool;
+    PostContext post;
+    Coverage coverage;
+    if (poolInit(&pool, opts.threads) < 0 || postInit(&post, &opts.post, &frame) < 0 ||
+        coverageInit(&coverage, WINDOW_WIDTH, WINDOW_HEIGHT) < 0) {
+        fprintf(stderr, "Failed to set up tile workers\n");
+        return 1;
+    }
+    AovBuffers aov;
+    int aovEnabled = opts.aovDump || opts.aovShm;
+    if (aovEnabled && aovInit(&aov, &opts, WINDOW_WIDTH, WINDOW_HEIGHT) < 0) {
+        fprintf(stderr, "Failed to set up AOV export\n");
+        return 1;
+    }
+
+    Plane rotatedPlanes[MAX_PLANES];
+    RenderContext ctx;
+    ctx.planes = rotatedPlanes;
+    ctx.numPlanes = numPlanes;
+    ctx.angle = 0;
+    setCamera(&ctx, (Vec3){ 0, 0, -5 }, (Vec3){ 0, 0, 0 }, (Vec3){ 0, 1, 0 });
+    ctx.scaleFactor = 300.0;  // Screen-space scaling (I'm Lazy)
+    ctx.halfWidth = WINDOW_WIDTH / 2.0;
+    ctx.halfHeight = WINDOW_HEIGHT / 2.0;
+    ctx.fovea = opts.fovea;
+    ctx.frame = &frame;
+    ctx.aov = aovEnabled ? &aov : NULL;
+    ctx.pt = NULL;
+    ctx.progressive = NULL;
+    ctx.env = NULL;
+    if (ensureBackground(&opts.background, WINDOW_WIDTH, WINDOW_HEIGHT) < 0) {
+        fprintf(stderr, "Failed to allocate background layer\n");
+        return 1;
+    }
+    ctx.background = opts.background.pixels;
+    ctx.translucency = opts.translucency.mode ? &opts.translucency : NULL;
+    ctx.scalarKernel = 0;
+    ctx.scene = NULL;
+
+    Scene scene;
+    SceneWatch sceneWatch;
+    SceneView sceneView;
+    memset(&scene, 0, sizeof(scene));
+    memset(&sceneView, 0, sizeof(sceneView));
+    scene.fd = -1;
+    Vec3 lastCamPos = ctx.camPos;
+    Uint32 lastCamTime = 0;
+    Fracture fracture;
+    memset(&fracture, 0, sizeof(fracture));
+    int sceneEnabled = (opts.scenePath || opts.shatter > 0) && !opts.playPath && !opts.viewAddr;
+    if (sceneEnabled && opts.shatter > 0) {
+        Uint64 start = SDL_GetPerformanceCounter();
+        if (fractureBuild(&pool, &scene, &fracture, basePlanes, numPlanes, opts.shatter) < 0)
+            return 1;
+        printf("Shatter: %d shards of %.1f planes on average, cut in %.1f ms\n", fracture.count,
+               fracture.planesPerShard, (SDL_GetPerformanceCounter() - start) * 1000.0 / SDL_GetPerformanceFrequency());
+    }
+    if (sceneEnabled) {
+        if (opts.scenePath && (sceneOpen(&scene, opts.scenePath, (size_t)opts.sceneBudget << 20) < 0 ||
+                               sceneWatchOpen(&sceneWatch, opts.scenePath) < 0))
+            return 1;
+        if (opts.scenePath)
+            printf("Scene: %s, %u instances in %d chunks\n", opts.scenePath, scene.header->numInstances,
+                   scene.numChunks);
+        ctx.scene = &sceneView;
+        sceneView.lodSprite = opts.lodSprite;
+        sceneView.lodDisc = opts.lodDisc;
+        sceneView.occlusion = opts.occlusion;
+    }
+
+    Wall wall;
+    memset(&wall, 0, sizeof(wall));
+    int wallEnabled = opts.wallCols > 0 && !opts.playPath && !opts.viewAddr;
+    if (wallEnabled) {
+        wall.cols = opts.wallCols;
+        wall.rows = opts.wallRows;
+        wall.index = opts.wallIndex;
+        wall.shmName = opts.wallShm;
+        if (wallOpen(&wall) < 0)
+            return 1;
+        // this window is one cell of a canvas cols x rows windows big
+        ctx.scaleFactor *= fmin(wall.cols, wall.rows);
+        ctx.halfWidth = WINDOW_WIDTH * wall.cols / 2.0 - (wall.index % wall.cols) * WINDOW_WIDTH;
+        ctx.halfHeight = WINDOW_HEIGHT * wall.rows / 2.0 - (wall.index / wall.cols) * WINDOW_HEIGHT;
+        char title[64];
+        snprintf(title, sizeof(title), "Dodecahedron - wall %d,%d", wall.index % wall.cols, wall.index / wall.cols);
+        SDL_SetWindowTitle(window, title);
+    }
+
+    Viewport views[MAX_VIEWPORTS];
+    int numViews = 0;
+    if (opts.views && !opts.playPath && !opts.viewAddr &&
+        (numViews = viewportsInit(views, opts.views, &ctx, &opts.background)) < 0)
+        return 1;
+
+    Vec3 lightDir = normalize((Vec3){ 1, 1, -1 });
+
+    PathTracer pt;
+    memset(&pt, 0, sizeof(pt));
+    if (opts.pathTrace > 0) {
+        pt.accum = malloc(sizeof(float) * 3 * WINDOW_WIDTH * WINDOW_HEIGHT);
+        if (!pt.accum) {
+            fprintf(stderr, "Failed to allocate accumulation buffer\n");
+            return 1;
+        }
+        pt.sppPerFrame = opts.pathTrace;
+        pt.maxBounces = 4;
+        pt.lightDir = lightDir;
+        ctx.pt = &pt;
+    }
+
+    EnvLighting env;
+    memset(&env, 0, sizeof(env));
+    if (opts.ibl) {
+        if (envInit(&env, opts.envPath) < 0)
+            return 1;
+        env.roughness = opts.roughness > 1 ? 1 : opts.roughness;
+        env.exposure = 1.0f;
+        ctx.env = &env;
+    }
+
+    Progressive progressive;
+    memset(&progressive, 0, sizeof(progressive));
+    if (opts.progressive > 0) {
+        int tilesX = (WINDOW_WIDTH + TILE_SIZE - 1) / TILE_SIZE, tilesY = (WINDOW_HEIGHT + TILE_SIZE - 1) / TILE_SIZE;
+        progressive.numTiles = tilesX * tilesY;
+        progressive.tileStep = calloc(progressive.numTiles, 1);
+        progressive.tileSamples = calloc(progressive.numTiles, sizeof(uint16_t));
+        progressive.accum = malloc(sizeof(float) * 3 * WINDOW_WIDTH * WINDOW_HEIGHT);
+        if (!progressive.tileStep || !progressive.tileSamples || !progressive.accum) {
+            fprintf(stderr, "Failed to allocate progressive refinement state\n");
+            return 1;
+        }
+        progressive.maxSamples = 16;
+        progressive.angle = -1;
+        progressive.budget = SDL_GetPerformanceFrequency() * opts.progressive / 1000;
+        ctx.progressive = &progressive;
+    }
+
+    // coverage blends flat face colors, so it is off in the modes that shade per pixel
+    int analyticAA = opts.analyticAA && !ctx.pt && !ctx.progressive && !ctx.translucency &&
+                     !(ctx.env && env.roughness >= 0);
+    if (opts.analyticAA && !analyticAA)
+        printf("--aa only applies to flat shading, ignoring it\n");
+
+    ControlServer control;
+    int controlEnabled = opts.controlPath && !opts.playPath;
+    if (controlEnabled && controlOpen(&control, opts.controlPath) < 0)
+        return 1;
+    char backgroundSpec[CONTROL_LINE]; // image paths from the socket live here
+    int threads = opts.threads;
+    double speed = 1, angleOffset = 0;
+    Uint32 angleFrom = 0; // active time speed was last changed at
+    Uint32 statFrames = 0;
+    Uint64 statStart = SDL_GetPerformanceCounter(), statRenderTicks = 0;
+
+    MetricsServer metrics;
+    int metricsEnabled = opts.metricsPort > 0 && !opts.playPath;
+    if (metricsEnabled && metricsOpen(&metrics, opts.metricsPort) < 0)
+        return 1;
+    MetricsSnapshot live;
+    memset(&live, 0, sizeof(live));
+    Uint64 stageTicks[NUM_STAGES] = { 0 };
+    Uint64 lastPresent = SDL_GetPerformanceCounter(), busyBefore = 0;
+
+    StreamServer stream;
+    int streaming = opts.streamPort > 0 && !opts.playPath && !opts.viewAddr;
+    if (streaming && streamOpen(&stream, opts.streamPort, WINDOW_WIDTH, WINDOW_HEIGHT) < 0)
+        return 1;
+
+    Recorder recorder;
+    int recording = opts.recordPath && !opts.playPath;
+    if (recording && recorderOpen(&recorder, opts.recordPath, WINDOW_WIDTH, WINDOW_HEIGHT) < 0)
+        return 1;
+    Uint64 recordTicks = 0;
+
+    Uint32 frameCount = 0;
+    uint64_t tracedTotal = 0;
+    uint64_t edgeTotal = 0;
+    Uint64 postTicks = 0;
+    Uint64 aovTicks = 0;
+    uint32_t frameNumber = 0;
+    Uint32 lastDebugTime = SDL_GetTicks();
+
+    int running = 1, rc = 0;
+    int paused = 0;
+    if (opts.playPath) {
+        rc = playRecording(renderer, texture, &ctx, opts.playPath);
+        running = 0;
+    } else if (opts.viewAddr) {
+        rc = viewStream(renderer, &texture, &ctx, &opts.background, opts.viewAddr);
+        running = 0;
+    }
+    Uint32 pausedAt = 0, pausedTotal = 0;
+    SDL_Event event;
+    while (running) {
+        while (SDL_PollEvent(&event)) {
+            if (event.type == SDL_QUIT)
+                running = 0;
+            if (event.type == SDL_KEYDOWN && event.key.keysym.sym == SDLK_SPACE) {
+                paused = !paused;
+                if (paused)
+                    pausedAt = SDL_GetTicks();
+                else
+                    pausedTotal += SDL_GetTicks() - pausedAt;
+            }
+            if (event.type == SDL_MOUSEBUTTONDOWN) {
+                const RenderContext *pickCtx = &ctx;
+                int px = event.button.x * frame.width / WINDOW_WIDTH, py = event.button.y * frame.height / WINDOW_HEIGHT;
+                for (int v = 0; v < numViews; v++) {
+                    const SDL_Rect *r = &views[v].rect;
+                    if (event.button.x >= r->x && event.button.x < r->x + r->w &&
+                        event.button.y >= r->y && event.button.y < r->y + r->h) {
+                        pickCtx = &views[v].ctx;
+                        px = event.button.x - r->x;
+                        py = event.button.y - r->y;
+                    }
+                }
+                PickResult hit = pickAt(pickCtx, px, py);
+                if (hit.object < 0) {
+                    printf("Pick (%d, %d): background\n", event.button.x, event.button.y);
+                } else {
+                    printf("Pick (%d, %d): object %d face %d t=%.3f at (%.3f, %.3f, %.3f)%s\n",
+                           event.button.x, event.button.y, hit.object, hit.face, hit.t,
+                           hit.point.x, hit.point.y, hit.point.z, hit.fromBuffer ? "" : " [traced]");
+                }
+            }
+        }
+
+        Uint32 currentTime = SDL_GetTicks();
+        Uint32 activeTime = (paused ? pausedAt : currentTime) - pausedTotal;
+
+        ControlCommand cmds[16];
+        int numCmds = controlEnabled ? controlPoll(&control, cmds, 16) : 0;
+        for (int c = 0; c < numCmds; c++) {
+            const ControlCommand *cmd = &cmds[c];
+            switch (cmd->type) {
+            case CMD_THREADS:
+                poolDestroy(&pool);
+                busyBefore = 0;
+                if (poolInit(&pool, cmd->a) < 0) {
+                    fprintf(stderr, "Failed to restart tile workers\n");
+                    running = 0;
+                    rc = 1;
+                    controlReply(&control, cmd->client, "error: failed to restart tile workers");
+                    break;
+                }
+                threads = cmd->a;
+                controlReply(&control, cmd->client, "ok threads %d", threads);
+                break;
+            case CMD_SPEED:
+                angleOffset += speed * (activeTime - angleFrom) / 1000.0;
+                angleFrom = activeTime;
+                speed = cmd->value;
+                controlReply(&control, cmd->client, "ok speed %.3f", speed);
+                break;
+            case CMD_KERNEL:
+                ctx.scalarKernel = cmd->a;
+                controlReply(&control, cmd->client, "ok kernel %s", cmd->a ? "scalar" : "batch");
+                break;
+            case CMD_RESOLUTION:
+                if (cmd->a < 16 || cmd->b < 16 || cmd->a > WINDOW_WIDTH || cmd->b > WINDOW_HEIGHT) {
+                    controlReply(&control, cmd->client, "error: resolution must be within 16x16 and %dx%d",
+                                 WINDOW_WIDTH, WINDOW_HEIGHT);
+                    break;
+                }
+                // these all hold buffers laid out for the starting size
+                if (opts.post.bloom || opts.post.outline || opts.post.lut || aovEnabled || ctx.progressive || recording ||
+                    numViews || wallEnabled) {
+                    controlReply(&control, cmd->client, "error: resolution is fixed with post effects, AOVs, "
+                                 "--progressive, --record, --views or --wall");
+                    break;
+                }
+                SDL_DestroyTexture(texture);
+                texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING,
+                                            cmd->a, cmd->b);
+                if (!texture || ensureBackground(&opts.background, cmd->a, cmd->b) < 0) {
+                    fprintf(stderr, "Failed to resize to %dx%d: %s\n", cmd->a, cmd->b, SDL_GetError());
+                    running = 0;
+                    rc = 1;
+                    break;
+                }
+                ctx.scaleFactor *= (double)cmd->a / frame.width;
+                frame.width = cmd->a;
+                frame.height = cmd->b;
+                frame.idsValid = 0;
+                ctx.halfWidth = cmd->a / 2.0;
+                ctx.halfHeight = cmd->b / 2.0;
+                ctx.background = opts.background.pixels;
+                pt.samples = 0;
+                controlReply(&control, cmd->client, "ok resolution %dx%d", cmd->a, cmd->b);
+                break;
+            case CMD_BACKGROUND: {
+                // the current image path may live in backgroundSpec, so
+                // only overwrite it once the new spec is known to be good
+                Background bg = opts.background;
+                if (parseBackground(cmd->text, &bg) < 0) {
+                    controlReply(&control, cmd->client, "error: bad background");
+                    break;
+                }
+                strcpy(backgroundSpec, cmd->text);
+                if (bg.kind == BG_IMAGE)
+                    bg.path = backgroundSpec;
+                opts.background = bg;
+                opts.background.dirty = 1;
+                if (ensureBackground(&opts.background, frame.width, frame.height) < 0) {
+                    controlReply(&control, cmd->client, "error: out of memory");
+                    break;
+                }
+                ctx.background = opts.background.pixels;
+                controlReply(&control, cmd->client, "ok background %s", backgroundSpec);
+                break;
+            }
+            case CMD_STATS: {
+                double sec = (SDL_GetPerformanceCounter() - statStart) / (double)SDL_GetPerformanceFrequency();
+                double perFrame = statFrames ? 1000.0 / statFrames : 0;
+                controlReply(&control, cmd->client,
+                             "ok frames=%u fps=%.2f frame_ms=%.3f render_ms=%.3f threads=%d kernel=%s "
+                             "speed=%.3f resolution=%dx%d", statFrames, sec > 0 ? statFrames / sec : 0,
+                             sec * perFrame, statRenderTicks * perFrame / SDL_GetPerformanceFrequency(),
+                             threads, ctx.scalarKernel ? "scalar" : "batch", speed, frame.width, frame.height);
+                statFrames = 0;
+                statRenderTicks = 0;
+                statStart = SDL_GetPerformanceCounter();
+                break;
+            }
+            }
+        }
+        if (!running)
+            break;
+        double angle = angleOffset + speed * (activeTime - angleFrom) / 1000.0;
+        if (wallEnabled && wallFrameStart(&wall, &angle) < 0) {
+            printf("Wall: lost contact with the other cells, running alone\n");
+            wallClose(&wall);
+            wallEnabled = 0;
+        }
+
+        if (sceneEnabled && opts.flySpeed > 0)
+            flyCamera(&ctx, activeTime / 1000.0, opts.flySpeed);
+
+        // d should now remain unchanged
+        for (int i = 0; i < numPlanes; i++) {
+            rotatedPlanes[i].n = rotate(basePlanes[i].n, angle);
+            rotatedPlanes[i].d = basePlanes[i].d;
+        }
+        ctx.angle = angle;
+
+        if (ctx.env)
+            buildFaceColorsEnv(rotatedPlanes, numPlanes, ctx.env, ctx.faceColor);
+        else
+            buildFaceColors(rotatedPlanes, numPlanes, lightDir, ctx.faceColor);
+        for (int v = 0; v < numViews; v++) {
+            views[v].ctx.angle = angle;
+            memcpy(views[v].ctx.faceColor, ctx.faceColor, sizeof(ctx.faceColor));
+        }
+
+        // a new scene file only replaces the old mapping once it checks out
+        if (sceneEnabled && opts.scenePath && sceneWatchPoll(&sceneWatch)) {
+            Scene next;
+            Uint64 loadStart = SDL_GetPerformanceCounter();
+            if (sceneOpen(&next, opts.scenePath, (size_t)opts.sceneBudget << 20) == 0) {
+                sceneClose(&scene);
+                scene = next;
+                printf("Scene: reloaded %s, %u instances in %.3f ms\n", opts.scenePath, scene.header->numInstances,
+                       (SDL_GetPerformanceCounter() - loadStart) * 1000.0 / SDL_GetPerformanceFrequency());
+            } else {
+                printf("Scene: keeping the current scene\n");
+            }
+        }
+
+        // for each tile cast rays and test intersection with the convex polyhedron
+        if (aovEnabled)
+            aovBeginFrame(&aov);
+        Uint64 renderStart = SDL_GetPerformanceCounter();
+        // prefetch looks ahead along the camera's current velocity
+        RenderContext ahead = ctx;
+        int moving = currentTime > lastCamTime && (ctx.camPos.x != lastCamPos.x || ctx.camPos.y != lastCamPos.y ||
+                                                   ctx.camPos.z != lastCamPos.z);
+        if (moving) {
+            ahead.camPos = add(ctx.camPos, scale(subtract(ctx.camPos, lastCamPos),
+                                                 (double)SCENE_PREFETCH_MS / (currentTime - lastCamTime)));
+        }
+        lastCamPos = ctx.camPos;
+        lastCamTime = currentTime;
+        if (fracture.count)
+            fractureAnimate(&fracture, angle, activeTime);
+        if (sceneEnabled && sceneBuild(&pool, &sceneView, &scene, &ctx, moving ? &ahead : NULL, lightDir) < 0) {
+            fprintf(stderr, "Out of memory for the scene\n");
+            rc = 1;
+            break;
+        }
+        int traced = numViews ? renderViewports(&pool, views, numViews) : renderFrame(&pool, &ctx, &aovTicks);
+        tracedTotal += traced;
+        Uint64 aaStart = SDL_GetPerformanceCounter();
+        for (int v = 0; analyticAA && v < (numViews ? numViews : 1); v++) {
+            int edges = coverageResolve(&pool, &coverage, numViews ? &views[v].ctx : &ctx);
+            edgeTotal += edges > 0 ? edges : 0;
+        }
+        stageTicks[STAGE_RENDER] += aaStart - renderStart;
+        stageTicks[STAGE_AA] += SDL_GetPerformanceCounter() - aaStart;
+        statRenderTicks += SDL_GetPerformanceCounter() - renderStart;
+        statFrames++;
+        if (recording) {
+            Uint64 recordStart = SDL_GetPerformanceCounter();
+            if (recorderFrame(&recorder, &ctx) < 0) {
+                fprintf(stderr, "Failed to write %s, recording stopped\n", opts.recordPath);
+                recorderClose(&recorder, opts.recordPath);
+                recording = 0;
+            }
+            recordTicks += SDL_GetPerformanceCounter() - recordStart;
+            stageTicks[STAGE_RECORD] += SDL_GetPerformanceCounter() - recordStart;
+        }
+        if (streaming)
+            streamPost(&stream, &ctx, frameNumber);
+        if (aovEnabled) {
+            Uint64 exportStart = SDL_GetPerformanceCounter();
+            aovEndFrame(&aov, &frame, frameNumber);
+            aovTicks += SDL_GetPerformanceCounter() - exportStart;
+            stageTicks[STAGE_AOV] += SDL_GetPerformanceCounter() - exportStart;
+        }
+        frameNumber++;
+
+        Uint64 postStart = SDL_GetPerformanceCounter();
+        postProcess(&pool, &post);
+        postTicks += SDL_GetPerformanceCounter() - postStart;
+        stageTicks[STAGE_POST] += SDL_GetPerformanceCounter() - postStart;
+
+        if (wallEnabled && wallBarrier(&wall) < 0) {
+            printf("Wall: lost contact with the other cells, running alone\n");
+            wallClose(&wall);
+            wallEnabled = 0;
+        }
+        Uint64 presentStart = SDL_GetPerformanceCounter();
+        if (numViews) {
+            for (int v = 0; v < numViews; v++)
+                SDL_UpdateTexture(texture, &views[v].rect, views[v].frame.pixels, views[v].frame.width * sizeof(uint32_t));
+        } else {
+            SDL_UpdateTexture(texture, NULL, pixels, frame.width * sizeof(uint32_t));
+        }
+        SDL_RenderClear(renderer);
+        SDL_RenderCopy(renderer, texture, NULL, NULL);
+        SDL_RenderPresent(renderer);
+        Uint64 presented = SDL_GetPerformanceCounter();
+        if (wallEnabled)
+            wallPresented(&wall);
+        stageTicks[STAGE_PRESENT] += presented - presentStart;
+
+        if (metricsEnabled) {
+            double freq = (double)SDL_GetPerformanceFrequency();
+            metricsRecordFrame(&live, (presented - lastPresent) / freq);
+            live.rays += traced;
+            live.planesPerPixel = (double)traced * numPlanes / (frame.width * frame.height);
+            live.threads = pool.numWorkers + 1;
+            Uint64 busy = 0;
+            for (int t = 0; t < live.threads; t++) {
+                busy += pool.busy[t];
+                live.threadBusySeconds[t] = pool.busy[t] / freq;
+            }
+            live.utilization = (busy - busyBefore) / ((double)(presented - lastPresent) * live.threads);
+            busyBefore = busy;
+            for (int s = 0; s < NUM_STAGES; s++)
+                live.stageSeconds[s] = stageTicks[s] / freq;
+            metricsPublish(&metrics, &live);
+        }
+        lastPresent = presented;
+
+        frameCount++;
+        if (currentTime - lastDebugTime >= 1000) {
+            double fps = frameCount * 1000.0 / (currentTime - lastDebugTime);
+            printf("FPS: %.2f | Angle: %.2f rad | Frames: %u | Planes: %d\n", fps, angle, frameCount, numPlanes);
+            if (ctx.fovea.innerRadius > 0) {
+                double perFrame = (double)tracedTotal / frameCount;
+                double total = (double)WINDOW_WIDTH * WINDOW_HEIGHT;
+                printf("Fovea: traced %.0f/%.0f px per frame, saved %.0f (%.1f%%)\n",
+                       perFrame, total, total - perFrame, 100.0 * (1.0 - perFrame / total));
+            }
+            if (opts.post.bloom || opts.post.outline || opts.post.lut) {
+                printf("Post: %.2f ms per frame\n",
+                       postTicks * 1000.0 / SDL_GetPerformanceFrequency() / frameCount);
+            }
+            if (ctx.pt) {
+                char title[64];
+                snprintf(title, sizeof(title), "Dodecahedron - %d spp", pt.samples);
+                SDL_SetWindowTitle(window, title);
+                printf("Path trace: %d samples per pixel%s\n", pt.samples, paused ? "" : " (rotating, press space)");
+            }
+            if (ctx.progressive) {
+                int finest = PROGRESSIVE_START, samples = progressive.maxSamples;
+                for (int t = 0; t < progressive.numTiles; t++) {
+                    if (progressive.tileStep[t] < finest)
+                        finest = progressive.tileStep[t];
+                    if (progressive.tileSamples[t] < samples)
+                        samples = progressive.tileSamples[t];
+                }
+                printf("Progressive: %s, %d tiles still refining, rays %.0f per frame\n",
+                       finest > 1 ? (finest == 8 ? "1/8" : finest == 4 ? "1/4" : "1/2") : "full res",
+                       SDL_AtomicGet(&progressive.pending), (double)tracedTotal / frameCount);
+                if (finest == 1)
+                    printf("Progressive: at least %d supersamples per pixel\n", samples + 1);
+            }
+            if (recording) {
+                printf("Record: %u frames, %.2f ms per frame encode + write\n", recorder.header.frameCount,
+                       recordTicks * 1000.0 / SDL_GetPerformanceFrequency() / frameCount);
+            }
+            if (streaming) {
+                printf("Stream: %d viewers, %.1f KB/s, dropped %d behind viewers + %d while encoding\n",
+                       SDL_AtomicGet(&stream.numClients),
+                       SDL_AtomicSet(&stream.bytesSent, 0) / 1.024 / (currentTime - lastDebugTime),
+                       SDL_AtomicSet(&stream.droppedClient, 0), SDL_AtomicSet(&stream.droppedSource, 0));
+            }
+            if (wallEnabled) {
+                printf("Wall: cell %d of %dx%d, frame %u, %.2f ms per frame in barriers", wall.index, wall.cols,
+                       wall.rows, wall.shared->frame, wall.waitTicks * 1000.0 / SDL_GetPerformanceFrequency() / frameCount);
+                if (wall.skewFrames)
+                    printf(", present skew avg %.3f ms max %.3f ms", wall.skewSum / wall.skewFrames, wall.skewMax);
+                printf("\n");
+                wall.waitTicks = 0;
+                wall.skewSum = wall.skewMax = 0;
+                wall.skewFrames = 0;
+            }
+            if (sceneEnabled) {
+                double pixels = (double)frame.width * frame.height * frameCount;
+                printf("Scene: %u instances, %d on screen, %.1f per tile, %.2f instance tests per pixel\n",
+                       scene.header->numInstances, sceneView.numItems,
+                       (double)sceneView.binned / (((frame.width + TILE_SIZE - 1) / TILE_SIZE) *
+                                                   ((frame.height + TILE_SIZE - 1) / TILE_SIZE)),
+                       SDL_AtomicSet(&sceneView.tests, 0) / pixels);
+                if (opts.lodSprite > 0) {
+                    printf("LOD: %.0f traced, %.0f sprites, %.0f discs per frame\n",
+                           (double)sceneView.lodCount[LOD_FULL] / frameCount,
+                           (double)sceneView.lodCount[LOD_SPRITE] / frameCount,
+                           (double)sceneView.lodCount[LOD_DISC] / frameCount);
+                }
+                memset(sceneView.lodCount, 0, sizeof(sceneView.lodCount));
+                if (opts.occlusion) {
+                    printf("Hi-Z: %.0f of %.0f instances culled per frame behind %.0f occluders, %.3f ms\n",
+                           (double)sceneView.hizCulled / frameCount, (double)sceneView.hizTested / frameCount,
+                           (double)sceneView.hizOccluders / frameCount,
+                           sceneView.hizTicks * 1000.0 / SDL_GetPerformanceFrequency() / frameCount);
+                    sceneView.hizCulled = sceneView.hizTested = sceneView.hizOccluders = 0;
+                    sceneView.hizTicks = 0;
+                }
+                if (scene.numChunks) {
+                    printf("Chunks: %.0f in view per frame, %.1f + %.1f requested of %d MB resident, "
+                           "%d drawn as impostors, %d read ahead, %d evicted\n",
+                           (double)scene.chunksVisible / frameCount, scene.residentBytes / 1048576.0,
+                           scene.requestedBytes / 1048576.0, opts.sceneBudget, scene.impostors,
+                           scene.requested, scene.evicted);
+                    scene.chunksVisible = scene.impostors = scene.requested = scene.evicted = 0;
+                }
+            }
+            if (analyticAA)
+                printf("AA: %.0f edge pixels per frame\n", (double)edgeTotal / frameCount);
+            if (aovEnabled) {
+                printf("AOV: %.2f ms per frame (CPU time, fill + export)\n",
+                       aovTicks * 1000.0 / SDL_GetPerformanceFrequency() / frameCount);
+            }
+            lastDebugTime = currentTime;
+            frameCount = 0;
+            tracedTotal = 0;
+            edgeTotal = 0;
+            recordTicks = 0;
+            postTicks = 0;
+            aovTicks = 0;
+        }
+        SDL_Delay(1);
+    }
+
+    if (recording && recorderClose(&recorder, opts.recordPath) < 0)
+        rc = 1;
+    if (controlEnabled)
+        controlClose(&control);
+    if (metricsEnabled)
+        metricsClose(&metrics);
+    if (streaming)
+        streamClose(&stream);
+    poolDestroy(&pool);
+    postFree(&post);
+    coverageFree(&coverage);
+    viewportsFree(views, numViews);
+    if (wallEnabled)
+        wallClose(&wall);
+    if (sceneEnabled) {
+        sceneClose(&scene);
+        if (opts.scenePath)
+            close(sceneWatch.fd);
+    }
+    free(fracture.shards);
+    sceneViewFree(&sceneView);
+    free(pt.accum);
+    free(opts.background.pixels);
+    envFree(&env);
+    free(progressive.tileStep);
+    free(progressive.tileSamples);
+    free(progressive.accum);
+    if (aovEnabled)
+        aovFree(&aov, opts.aovShm);
+    free(opts.post.lut);
+    free(pixels);
+    free(faceIds);
+    SDL_DestroyTexture(texture);
+    SDL_DestroyRenderer(renderer);
+    SDL_DestroyWindow(window);
+    SDL_Quit();
+    return rc;
+}
+#endif